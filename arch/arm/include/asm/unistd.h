@@ -396,6 +396,10 @@
 #define __NR_fanotify_init		(__NR_SYSCALL_BASE+367)
 #define __NR_fanotify_mark		(__NR_SYSCALL_BASE+368)
 #define __NR_prlimit64			(__NR_SYSCALL_BASE+369)
+#define __NR_process_vm_readv		(__NR_SYSCALL_BASE+370)
+#define __NR_process_vm_writev		(__NR_SYSCALL_BASE+371)
+#define __NR_sched_setattr		(__NR_SYSCALL_BASE+372)
+#define __NR_sched_getattr		(__NR_SYSCALL_BASE+373)
 
 /*
  * The following SWIs are ARM private.
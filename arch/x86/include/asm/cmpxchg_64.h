@@ -151,4 +151,10 @@ extern void __cmpxchg_wrong_size(void);
 	cmpxchg_local((ptr), (o), (n));					\
 })
 
+/*
+ * cmpxchg16b is missing on the very first AMD64 processors, so users of
+ * the double word operations have to check for it at runtime.
+ */
+#define system_has_cmpxchg_double() cpu_has_cx16
+
 #endif /* _ASM_X86_CMPXCHG_64_H */
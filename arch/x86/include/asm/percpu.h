@@ -324,6 +324,34 @@ do {									\
 #define irqsafe_cpu_or_8(pcp, val)	percpu_to_op("or", (pcp), val)
 #define irqsafe_cpu_xor_8(pcp, val)	percpu_to_op("xor", (pcp), val)
 
+/*
+ * Compare and exchange two adjacent, 16 byte aligned per cpu words in one
+ * go. pcp1 must be the first of the two words. Being a single instruction
+ * on the local cpu it is safe against both preemption and interrupts.
+ * Only usable if system_has_cmpxchg_double().
+ */
+#define percpu_cmpxchg16b_double(pcp1, pcp2, o1, o2, n1, n2)		\
+({									\
+	char __ret;							\
+	typeof(o1) __o1 = (o1);						\
+	typeof(o2) __o2 = (o2);						\
+	typeof(n1) __n1 = (n1);						\
+	typeof(n2) __n2 = (n2);						\
+	asm volatile("cmpxchg16b "__percpu_arg(1)"\n\tsetz %0"		\
+		     : "=qm" (__ret), "+m" (pcp1), "+m" (pcp2),		\
+		       "+a" (__o1), "+d" (__o2)				\
+		     : "b" (__n1), "c" (__n2)				\
+		     : "memory");					\
+	__ret;								\
+})
+
+#define __this_cpu_cmpxchg_double(pcp1, pcp2, o1, o2, n1, n2)		\
+	percpu_cmpxchg16b_double(pcp1, pcp2, o1, o2, n1, n2)
+#define this_cpu_cmpxchg_double(pcp1, pcp2, o1, o2, n1, n2)		\
+	percpu_cmpxchg16b_double(pcp1, pcp2, o1, o2, n1, n2)
+#define irqsafe_cpu_cmpxchg_double(pcp1, pcp2, o1, o2, n1, n2)		\
+	percpu_cmpxchg16b_double(pcp1, pcp2, o1, o2, n1, n2)
+
 #endif
 
 /* This is not atomic against other CPUs -- CPU preemption needs to be off */
@@ -83,6 +83,10 @@ struct rw_semaphore {
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map dep_map;
 #endif
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	/* the writer holding the lock, or RWSEM_READER_OWNED */
+	struct thread_info	*owner;
+#endif
 };
 
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
@@ -8,6 +8,7 @@
 #include <linux/mm.h>
 #include <linux/vmstat.h>
 #include <linux/highmem.h>
+#include <linux/hugetlb.h>
 
 #include <asm/pgtable.h>
 
@@ -151,6 +152,14 @@ static int gup_pmd_range(pud_t pud, unsigned long addr, unsigned long end,
 		if (pmd_none(pmd))
 			return 0;
 		if (unlikely(pmd_large(pmd))) {
+			/*
+			 * Transparent huge pages may be split under us,
+			 * which the head-page refcounting of the fast
+			 * path can't cope with: leave them to the slow
+			 * path, which splits them first.
+			 */
+			if (!PageHuge(pmd_page(pmd)))
+				return 0;
 			if (!gup_huge_pmd(pmd, addr, next, write, pages, nr))
 				return 0;
 		} else {
@@ -104,16 +104,37 @@ static void give_pages(struct virtnet_info *vi, struct page *page)
 	vi->pages = page;
 }
 
+/*
+ * Number of pages allocated at once when vi->pages runs dry: enough for
+ * one big packet buffer, or that many mergeable buffers.
+ */
+#define VIRTNET_PAGE_BATCH	(MAX_SKB_FRAGS + 2)
+
+static void alloc_pages_batch(struct virtnet_info *vi, gfp_t gfp_mask)
+{
+	struct page *pages[VIRTNET_PAGE_BATCH] = { NULL };
+	unsigned long i, nr;
+
+	nr = alloc_pages_bulk_array(gfp_mask, VIRTNET_PAGE_BATCH, pages);
+	for (i = 0; i < nr; i++) {
+		pages[i]->private = (unsigned long)vi->pages;
+		vi->pages = pages[i];
+	}
+}
+
 static struct page *get_a_page(struct virtnet_info *vi, gfp_t gfp_mask)
 {
-	struct page *p = vi->pages;
+	struct page *p;
+
+	if (!vi->pages)
+		alloc_pages_batch(vi, gfp_mask);
 
+	p = vi->pages;
 	if (p) {
 		vi->pages = (struct page *)p->private;
 		/* clear private here, it is used to chain pages */
 		p->private = 0;
-	} else
-		p = alloc_page(gfp_mask);
+	}
 	return p;
 }
 
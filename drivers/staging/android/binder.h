@@ -32,6 +32,7 @@ enum {
 	BINDER_TYPE_HANDLE	= B_PACK_CHARS('s', 'h', '*', B_TYPE_LARGE),
 	BINDER_TYPE_WEAK_HANDLE	= B_PACK_CHARS('w', 'h', '*', B_TYPE_LARGE),
 	BINDER_TYPE_FD		= B_PACK_CHARS('f', 'd', '*', B_TYPE_LARGE),
+	BINDER_TYPE_PTR		= B_PACK_CHARS('p', 't', '*', B_TYPE_LARGE),
 };
 
 enum {
@@ -61,6 +62,33 @@ struct flat_binder_object {
 	void			*cookie;
 };
 
+enum {
+	BINDER_BUFFER_FLAG_HAS_PARENT = 0x01,
+};
+
+/*
+ * A user buffer sent with BC_TRANSACTION_SG or BC_REPLY_SG (single-copy
+ * scatter-gather).  The driver copies 'length' bytes from 'buffer' into
+ * the extra buffers area of the target's binder_buffer and rewrites
+ * 'buffer' to point at the copy.  If BINDER_BUFFER_FLAG_HAS_PARENT is set, 'parent' is the
+ * index in the offsets array of an earlier binder_buffer_object and the
+ * pointer at 'parent_offset' inside that buffer is rewritten as well, so
+ * that nested structures stay intact without the sender flattening them.
+ *
+ * This saves the sender's copy into a flat parcel, not the driver's copy:
+ * the payload is still copied once, from the sender into pages owned by
+ * the target's binder mapping.  Sender pages are never mapped into the
+ * target.
+ */
+struct binder_buffer_object {
+	unsigned long		type;
+	unsigned long		flags;
+	void			*buffer;
+	size_t			length;
+	size_t			parent;
+	size_t			parent_offset;
+};
+
 /*
  * On 64-bit platforms where user code may run in 32-bits the driver must
  * translate the buffer (and local binder) addresses apropriately.
@@ -147,6 +175,12 @@ struct binder_transaction_data {
 	} data;
 };
 
+struct binder_transaction_data_sg {
+	struct binder_transaction_data transaction_data;
+	/* total size of all binder_buffer_objects, each rounded up to 8 */
+	size_t buffers_size;
+};
+
 struct binder_ptr_cookie {
 	void *ptr;
 	void *cookie;
@@ -324,6 +358,14 @@ enum BinderDriverCommandProtocol {
 	/*
 	 * void *: cookie
 	 */
+
+	BC_TRANSACTION_SG = _IOW('c', 17, struct binder_transaction_data_sg),
+	BC_REPLY_SG = _IOW('c', 18, struct binder_transaction_data_sg),
+	/*
+	 * binder_transaction_data_sg: the sent command, with buffers_size
+	 * bytes reserved in the target for binder_buffer_objects.  These are
+	 * single-copy, not zero-copy, transactions: see binder_buffer_object.
+	 */
 };
 
 #endif /* _LINUX_BINDER_H */
@@ -25,6 +25,11 @@
 #include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+#include <linux/jiffies.h>
+#include <linux/rculist.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
@@ -34,15 +39,22 @@
  *
  * This structure lives from module insertion until module removal, so it does
  * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * spinlock 'lock', which is never held across a copy into or out of the ring:
+ * writers only reserve their space under it and fill it in afterwards, and
+ * readers copy the entry out into a private buffer.
+ *
+ * Entries between 'c_off' and 'w_off' are still being written. Readers only
+ * see the log up to 'c_off', which the last of the writers to finish moves
+ * up to 'w_off'.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
-	wait_queue_head_t	wq;	/* wait queue for readers */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
+	spinlock_t		lock;	/* lock protecting buffer */
 	size_t			w_off;	/* current write head offset */
+	size_t			c_off;	/* end of the completed entries */
+	int			writers; /* writers filling in their space */
 	size_t			head;	/* new readers start here */
 	size_t			size;	/* size of the log */
 };
@@ -51,14 +63,39 @@ struct logger_log {
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. Everything but 'mutex', 'buf' and 'wq' is protected
+ * by log->lock; 'mutex' serializes reads on the same file, which share 'buf'.
+ * Writers also walk the list of readers under RCU, to wake them up after
+ * dropping log->lock.
+ *
+ * A blocked reader is only woken once 'wake_bytes' are pending, or once
+ * 'wake_ms' have passed since the first pending entry was written.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
 	struct list_head	list;	/* entry in logger_log's list */
 	size_t			r_off;	/* current read head offset */
+	struct mutex		mutex;	/* serializes reads of this reader */
+	unsigned char		*buf;	/* bounce buffer for one entry */
+	wait_queue_head_t	wq;	/* wait queue for this reader */
+	struct timer_list	timer;	/* fires 'wake_ms' after 'since' */
+	unsigned long		since;	/* jiffies of first pending write */
+	size_t			wake_bytes; /* wake up threshold in bytes */
+	unsigned int		wake_ms; /* wake up threshold in ms */
+	bool			batch;	/* read() returns many entries */
+	bool			wake;	/* to be woken by the writer */
+};
+
+/*
+ * struct logger_scratch - per-cpu staging area for a writer's payload,
+ * filled with page faults disabled before log->lock is taken.
+ */
+struct logger_scratch {
+	unsigned char		buf[LOGGER_ENTRY_MAX_PAYLOAD];
 };
 
+static struct logger_scratch __percpu *logger_scratch;
+
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
@@ -89,7 +126,7 @@ static inline struct logger_log *file_get_log(struct file *file)
  * get_entry_len - Grabs the length of the payload of the next entry starting
  * from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_len(struct logger_log *log, size_t off)
 {
@@ -108,15 +145,48 @@ static __u32 get_entry_len(struct logger_log *log, size_t off)
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * get_pending_len - returns the number of bytes 'reader' has yet to read.
+ *
+ * Caller needs to hold log->lock.
+ */
+static size_t get_pending_len(struct logger_log *log,
+			      struct logger_reader *reader)
+{
+	if (log->c_off >= reader->r_off)
+		return log->c_off - reader->r_off;
+	return (log->size - reader->r_off) + log->c_off;
+}
+
+/*
+ * reader_is_ready - should a blocked 'reader' be woken up? Without any
+ * thresholds set this is true as soon as there is something to read.
+ * With both set, whichever is reached first counts.
+ *
+ * Caller needs to hold log->lock.
+ */
+static int reader_is_ready(struct logger_log *log,
+			   struct logger_reader *reader)
+{
+	size_t len = get_pending_len(log, reader);
+
+	if (!len)
+		return 0;
+	if (reader->wake_bytes && len >= reader->wake_bytes)
+		return 1;
+	if (reader->wake_ms)
+		return time_after_eq(jiffies, reader->since +
+				     msecs_to_jiffies(reader->wake_ms));
+	return !reader->wake_bytes;
+}
+
+/*
+ * do_read_log - reads exactly 'count' bytes at offset 'off' of 'log' into
+ * the kernel buffer 'buf'. The caller advances the reader.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static void do_read_log(struct logger_log *log, size_t off,
+			unsigned char *buf, size_t count)
 {
 	size_t len;
 
@@ -125,21 +195,15 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 	 * the current read head offset up to 'count' bytes or to the end of
 	 * the log, whichever comes first.
 	 */
-	len = min(count, log->size - reader->r_off);
-	if (copy_to_user(buf, log->buffer + reader->r_off, len))
-		return -EFAULT;
+	len = min(count, log->size - off);
+	memcpy(buf, log->buffer + off, len);
 
 	/*
 	 * Second, we read any remaining bytes, starting back at the head of
 	 * the log.
 	 */
 	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
-
-	reader->r_off = logger_offset(reader->r_off + count);
-
-	return count;
+		memcpy(buf + len, log->buffer, count - len);
 }
 
 /*
@@ -148,8 +212,10 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
  * Behavior:
  *
  * 	- O_NONBLOCK works
- * 	- If there are no log entries to read, blocks until log is written to
- * 	- Atomically reads exactly one log entry
+ * 	- If there are no log entries to read, blocks until log is written to,
+ * 	  or until the reader's wake up threshold is reached
+ * 	- Atomically reads exactly one log entry, or with LOGGER_SET_READ_BATCH
+ * 	  as many whole entries as fit in 'buf'
  *
  * Optimal read size is LOGGER_ENTRY_MAX_LEN. Will set errno to EINVAL if read
  * buffer is insufficient to hold next entry.
@@ -159,16 +225,20 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	size_t copied = 0;
 	ssize_t ret;
 	DEFINE_WAIT(wait);
 
 start:
 	while (1) {
-		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
+		prepare_to_wait(&reader->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		spin_lock(&log->lock);
+		if (file->f_flags & O_NONBLOCK)
+			ret = (log->c_off == reader->r_off);
+		else
+			ret = !reader_is_ready(log, reader);
+		spin_unlock(&log->lock);
 		if (!ret)
 			break;
 
@@ -185,39 +255,69 @@ start:
 		schedule();
 	}
 
-	finish_wait(&log->wq, &wait);
+	finish_wait(&reader->wq, &wait);
 	if (ret)
 		return ret;
 
-	mutex_lock(&log->mutex);
+	mutex_lock(&reader->mutex);
+	spin_lock(&log->lock);
 
 	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
+	if (unlikely(log->c_off == reader->r_off)) {
+		spin_unlock(&log->lock);
+		mutex_unlock(&reader->mutex);
 		goto start;
 	}
 
-	/* get the size of the next entry */
-	ret = get_entry_len(log, reader->r_off);
-	if (count < ret) {
-		ret = -EINVAL;
-		goto out;
-	}
+	do {
+		size_t len, off = reader->r_off;
+
+		/* get the size of the next entry */
+		len = get_entry_len(log, off);
+		if (count - copied < len) {
+			spin_unlock(&log->lock);
+			if (!copied)
+				ret = -EINVAL;
+			break;
+		}
 
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+		/*
+		 * Get exactly one entry from the log. It is copied out under
+		 * the lock so that a writer lapping us cannot tear it, and
+		 * handed to user-space after the lock is dropped. The read
+		 * head is only moved past it once that succeeded, so a fault
+		 * leaves the entry to be read again.
+		 */
+		do_read_log(log, off, reader->buf, len);
+		spin_unlock(&log->lock);
+
+		if (copy_to_user(buf + copied, reader->buf, len)) {
+			if (!copied)
+				ret = -EFAULT;
+			break;
+		}
+		copied += len;
+
+		spin_lock(&log->lock);
+		/* a writer lapping us meanwhile already pulled us forward */
+		if (reader->r_off == off)
+			reader->r_off = logger_offset(off + len);
+		if (!reader->batch || log->c_off == reader->r_off) {
+			spin_unlock(&log->lock);
+			break;
+		}
+	} while (1);
 
-out:
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
-	return ret;
+	return ret ? ret : copied;
 }
 
 /*
  * get_next_entry - return the offset of the first valid entry at least 'len'
  * bytes after 'off'.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
 static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
 {
@@ -255,7 +355,7 @@ static inline int clock_interval(size_t a, size_t b, size_t c)
  * We do this by "pulling forward" the readers and start head to the first
  * entry after the new write head.
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void fix_up_readers(struct logger_log *log, size_t len)
 {
@@ -272,63 +372,87 @@ static void fix_up_readers(struct logger_log *log, size_t len)
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
+ * get_unfinished_len - returns the number of bytes reserved by writers that
+ * are still filling them in.
+ *
+ * The caller needs to hold log->lock.
+ */
+static size_t get_unfinished_len(struct logger_log *log)
+{
+	return logger_offset(log->w_off - log->c_off);
+}
+
+/*
+ * do_write_log - writes 'count' bytes from 'buf' to 'log' at offset 'off'
  *
- * The caller needs to hold log->mutex.
+ * The space must have been reserved by advancing log->w_off past it; the
+ * caller needs not hold log->lock.
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static void do_write_log(struct logger_log *log, size_t off, const void *buf,
+			 size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
 
 	if (count != len)
 		memcpy(log->buffer, buf + len, count - len);
-
-	log->w_off = logger_offset(log->w_off + count);
-
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
+ * copy_payload_from_user - gathers 'count' bytes of payload from the iovec
+ * into the kernel buffer 'buf'. With 'atomic' set, the copy is done with page
+ * faults disabled and fails instead of sleeping on a non-resident page.
  *
- * The caller needs to hold log->mutex.
- *
- * Returns 'count' on success, negative error code on failure.
+ * Returns zero on success, -EFAULT on failure.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
-				      const void __user *buf, size_t count)
+static int copy_payload_from_user(unsigned char *buf, const struct iovec *iov,
+				  unsigned long nr_segs, size_t count,
+				  bool atomic)
 {
-	size_t len;
-
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
-		return -EFAULT;
-
-	if (count != len)
-		if (copy_from_user(log->buffer, buf + len, count - len))
+	while (nr_segs-- > 0 && count) {
+		size_t len = min_t(size_t, iov->iov_len, count);
+
+		if (atomic) {
+			if (!access_ok(VERIFY_READ, iov->iov_base, len) ||
+			    __copy_from_user_inatomic(buf, iov->iov_base, len))
+				return -EFAULT;
+		} else if (copy_from_user(buf, iov->iov_base, len))
 			return -EFAULT;
 
-	log->w_off = logger_offset(log->w_off + count);
+		buf += len;
+		count -= len;
+		iov++;
+	}
 
-	return count;
+	return 0;
 }
 
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
  * them above all else.
+ *
+ * The payload is gathered from user-space before log->lock is taken. In the
+ * common case it is staged in this cpu's scratch buffer, with preemption
+ * disabled until it has been committed. If the user pages are not resident
+ * we fall back to a private buffer and may sleep.
+ *
+ * The lock is then only held to reserve space in the ring and, once the entry
+ * has been copied there, to make it visible to readers: concurrent writers
+ * copy their entries in parallel.
  */
 ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
+	struct logger_reader *reader;
 	struct logger_entry header;
 	struct timespec now;
-	ssize_t ret = 0;
+	unsigned char *payload, *kbuf = NULL;
+	size_t len, off, orig;
+	int nr_wake = 0;
 
 	now = current_kernel_time();
 
@@ -342,47 +466,126 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
+	payload = get_cpu_ptr(logger_scratch)->buf;
+	pagefault_disable();
+	if (unlikely(copy_payload_from_user(payload, iov, nr_segs,
+					    header.len, true))) {
+		pagefault_enable();
+		put_cpu_ptr(logger_scratch);
+
+		kbuf = kmalloc(header.len, GFP_KERNEL);
+		if (!kbuf)
+			return -ENOMEM;
+		if (copy_payload_from_user(kbuf, iov, nr_segs,
+					   header.len, false)) {
+			kfree(kbuf);
+			return -EFAULT;
+		}
+		payload = kbuf;
+		/* others may wait for our space, don't sleep on it */
+		preempt_disable();
+	} else
+		pagefault_enable();
+
+	len = sizeof(struct logger_entry) + header.len;
+	spin_lock(&log->lock);
+
+	/*
+	 * Space that is still being filled in can't be handed out again, and
+	 * the readers must not be pulled forward into it: if the writers
+	 * already hold almost all of the ring, wait for them to finish.
+	 */
+	while (unlikely(get_unfinished_len(log) + len + LOGGER_ENTRY_MAX_LEN >
+			log->size)) {
+		spin_unlock(&log->lock);
+		cpu_relax();
+		spin_lock(&log->lock);
+	}
 
 	/*
 	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
+	 * entry after (what will be) the new write offset.
 	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
+	fix_up_readers(log, len);
 
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	off = log->w_off;
+	log->w_off = logger_offset(off + len);
+	log->writers++;
+	spin_unlock(&log->lock);
 
-	while (nr_segs-- > 0) {
-		size_t len;
-		ssize_t nr;
+	do_write_log(log, off, &header, sizeof(struct logger_entry));
+	do_write_log(log, logger_offset(off + sizeof(struct logger_entry)),
+		     payload, header.len);
 
-		/* figure out how much of this vector we can keep */
-		len = min_t(size_t, iov->iov_len, header.len - ret);
+	spin_lock(&log->lock);
 
-		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
-		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
-		}
+	/*
+	 * The last writer to finish makes the entries of all of them
+	 * visible; until then readers stop short of the unfinished ones.
+	 */
+	if (--log->writers) {
+		spin_unlock(&log->lock);
+		goto out;
+	}
+	orig = log->c_off;
+	log->c_off = log->w_off;
 
-		iov++;
-		ret += nr;
+	/*
+	 * Start the clock of the readers that had nothing pending so far,
+	 * and pick the blocked readers that reached their threshold. A
+	 * reader adds itself to its wait queue before checking under
+	 * log->lock, so it can't be missed here.
+	 */
+	list_for_each_entry(reader, &log->readers, list) {
+		if (reader->r_off == orig) {
+			reader->since = jiffies;
+			if (reader->wake_ms)
+				mod_timer(&reader->timer, reader->since +
+					  msecs_to_jiffies(reader->wake_ms));
+		}
+		if (waitqueue_active(&reader->wq) &&
+		    reader_is_ready(log, reader)) {
+			reader->wake = true;
+			nr_wake++;
+		}
 	}
 
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
-	/* wake up any blocked readers */
-	wake_up_interruptible(&log->wq);
+out:
+	if (kbuf) {
+		preempt_enable();
+		kfree(kbuf);
+	} else
+		put_cpu_ptr(logger_scratch);
+
+	if (nr_wake) {
+		rcu_read_lock();
+		list_for_each_entry_rcu(reader, &log->readers, list) {
+			if (reader->wake) {
+				reader->wake = false;
+				wake_up_interruptible(&reader->wq);
+			}
+		}
+		rcu_read_unlock();
+	}
 
-	return ret;
+	return header.len;
 }
 
 static struct logger_log *get_log_from_minor(int);
 
+/*
+ * logger_reader_timeout - 'wake_ms' have passed since the first entry that
+ * is still pending for the reader was written.
+ */
+static void logger_reader_timeout(unsigned long data)
+{
+	struct logger_reader *reader = (struct logger_reader *) data;
+
+	wake_up_interruptible(&reader->wq);
+}
+
 /*
  * logger_open - the log's open() file operation
  *
@@ -408,13 +611,28 @@ static int logger_open(struct inode *inode, struct file *file)
 		if (!reader)
 			return -ENOMEM;
 
+		reader->buf = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+		if (!reader->buf) {
+			kfree(reader);
+			return -ENOMEM;
+		}
+
 		reader->log = log;
+		mutex_init(&reader->mutex);
+		init_waitqueue_head(&reader->wq);
+		setup_timer(&reader->timer, logger_reader_timeout,
+			    (unsigned long) reader);
+		reader->since = jiffies;
+		reader->wake_bytes = 0;
+		reader->wake_ms = 0;
+		reader->batch = false;
+		reader->wake = false;
 		INIT_LIST_HEAD(&reader->list);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
-		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		list_add_tail_rcu(&reader->list, &log->readers);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -432,7 +650,16 @@ static int logger_release(struct inode *ignored, struct file *file)
 {
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
-		list_del(&reader->list);
+		struct logger_log *log = reader->log;
+
+		spin_lock(&log->lock);
+		list_del_rcu(&reader->list);
+		spin_unlock(&log->lock);
+
+		del_timer_sync(&reader->timer);
+		/* a writer may still be about to wake us up */
+		synchronize_rcu();
+		kfree(reader->buf);
 		kfree(reader);
 	}
 
@@ -443,6 +670,7 @@ static int logger_release(struct inode *ignored, struct file *file)
  * logger_poll - the log's poll file operation, for poll/select/epoll
  *
  * Note we always return POLLOUT, because you can always write() to the log.
+ * POLLIN is only returned once the reader's wake up threshold is reached.
  * Note also that, strictly speaking, a return value of POLLIN does not
  * guarantee that the log is readable without blocking, as there is a small
  * chance that the writer can lap the reader in the interim between poll()
@@ -460,12 +688,12 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 	reader = file->private_data;
 	log = reader->log;
 
-	poll_wait(file, &log->wq, wait);
+	poll_wait(file, &reader->wq, wait);
 
-	mutex_lock(&log->mutex);
-	if (log->w_off != reader->r_off)
+	spin_lock(&log->lock);
+	if (reader_is_ready(log, reader))
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -476,7 +704,7 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	struct logger_reader *reader;
 	long ret = -ENOTTY;
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
@@ -488,10 +716,7 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
-		else
-			ret = (log->size - reader->r_off) + log->w_off;
+		ret = get_pending_len(log, reader);
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
@@ -499,7 +724,7 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off != reader->r_off)
+		if (log->c_off != reader->r_off)
 			ret = get_entry_len(log, reader->r_off);
 		else
 			ret = 0;
@@ -510,13 +735,49 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+			reader->r_off = log->c_off;
+		log->head = log->c_off;
+		ret = 0;
+		break;
+	case LOGGER_SET_READ_BATCH:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		reader->batch = !!arg;
+		ret = 0;
+		break;
+	case LOGGER_SET_WAKEUP_BYTES:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		/* anything larger could never be reached by a lapped reader */
+		if (arg > log->size / 2) {
+			ret = -EINVAL;
+			break;
+		}
+		reader = file->private_data;
+		reader->wake_bytes = arg;
+		ret = 0;
+		break;
+	case LOGGER_SET_WAKEUP_MS:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		if (arg > UINT_MAX) {
+			ret = -EINVAL;
+			break;
+		}
+		reader = file->private_data;
+		reader->wake_ms = arg;
 		ret = 0;
 		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -547,10 +808,11 @@ static struct logger_log VAR = { \
 		.fops = &logger_fops, \
 		.parent = NULL, \
 	}, \
-	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
 	.w_off = 0, \
+	.c_off = 0, \
+	.writers = 0, \
 	.head = 0, \
 	.size = SIZE, \
 };
@@ -594,23 +856,37 @@ static int __init logger_init(void)
 {
 	int ret;
 
+	logger_scratch = alloc_percpu(struct logger_scratch);
+	if (unlikely(!logger_scratch))
+		return -ENOMEM;
+
 	ret = init_log(&log_main);
 	if (unlikely(ret))
-		goto out;
+		goto out_free;
 
 	ret = init_log(&log_events);
 	if (unlikely(ret))
-		goto out;
+		goto out_main;
 
 	ret = init_log(&log_radio);
 	if (unlikely(ret))
-		goto out;
+		goto out_events;
 
 	ret = init_log(&log_system);
 	if (unlikely(ret))
-		goto out;
+		goto out_radio;
 
-out:
+	return 0;
+
+out_radio:
+	misc_deregister(&log_radio.misc);
+out_events:
+	misc_deregister(&log_events.misc);
+out_main:
+	misc_deregister(&log_main.misc);
+out_free:
+	free_percpu(logger_scratch);
+	logger_scratch = NULL;
 	return ret;
 }
 device_initcall(logger_init);
@@ -45,5 +45,8 @@ struct logger_entry {
 #define LOGGER_GET_LOG_LEN		_IO(__LOGGERIO, 2) /* used log len */
 #define LOGGER_GET_NEXT_ENTRY_LEN	_IO(__LOGGERIO, 3) /* next entry len */
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
+#define LOGGER_SET_READ_BATCH		_IO(__LOGGERIO, 5) /* multi-entry reads */
+#define LOGGER_SET_WAKEUP_BYTES		_IO(__LOGGERIO, 6) /* wake at N bytes */
+#define LOGGER_SET_WAKEUP_MS		_IO(__LOGGERIO, 7) /* or after N ms */
 
 #endif /* _LINUX_LOGGER_H */
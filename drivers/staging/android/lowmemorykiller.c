@@ -16,6 +16,10 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * Processes are kept in one list per oom_adj value, maintained on fork, exit,
+ * exec and oom_adj changes, so the shrinker only looks at the tasks in the
+ * highest non-empty bucket above the threshold rather than at every task.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -35,6 +39,12 @@
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/notifier.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+
+#define CREATE_TRACE_POINTS
+#include "trace/lowmemorykiller.h"
 
 static uint32_t lowmem_debug_level = 2;
 static int lowmem_adj[6] = {
@@ -55,6 +65,15 @@ static int lowmem_minfree_size = 4;
 static struct task_struct *lowmem_deathpending;
 static unsigned long lowmem_deathpending_timeout;
 
+/*
+ * Thread group leaders indexed by oom_adj, OOM_DISABLE being bucket 0. The
+ * lists are modified under lowmem_adj_lock and walked under rcu_read_lock(),
+ * task_structs being freed through RCU.
+ */
+#define LOWMEM_ADJ_BUCKETS	(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+static struct hlist_head lowmem_adj_index[LOWMEM_ADJ_BUCKETS];
+static DEFINE_SPINLOCK(lowmem_adj_lock);
+
 #define lowmem_print(level, x...)			\
 	do {						\
 		if (lowmem_debug_level >= (level))	\
@@ -79,13 +98,70 @@ task_notify_func(struct notifier_block *self, unsigned long val, void *data)
 	return NOTIFY_OK;
 }
 
+static struct hlist_head *lowmem_adj_bucket(int oom_adj)
+{
+	if (oom_adj < OOM_DISABLE)
+		oom_adj = OOM_DISABLE;
+	else if (oom_adj > OOM_ADJUST_MAX)
+		oom_adj = OOM_ADJUST_MAX;
+	return &lowmem_adj_index[oom_adj - OOM_DISABLE];
+}
+
+/*
+ * Called with tasklist_lock held for writing when p becomes a thread group
+ * leader, i.e. is added to the process list.
+ */
+void lowmem_adj_index_add(struct task_struct *p)
+{
+	spin_lock(&lowmem_adj_lock);
+	hlist_add_head_rcu(&p->lowmem_adj_node,
+			   lowmem_adj_bucket(p->signal->oom_adj));
+	spin_unlock(&lowmem_adj_lock);
+}
+
+/*
+ * Called with tasklist_lock held for writing when p is removed from the
+ * process list.
+ */
+void lowmem_adj_index_del(struct task_struct *p)
+{
+	spin_lock(&lowmem_adj_lock);
+	if (!hlist_unhashed(&p->lowmem_adj_node))
+		hlist_del_init_rcu(&p->lowmem_adj_node);
+	spin_unlock(&lowmem_adj_lock);
+}
+
+/*
+ * Called after the oom_adj of p's thread group changed. The new value is
+ * read under the lock so that racing updates leave the leader in the bucket
+ * of the last value written. A concurrent walker may follow the node into
+ * its new bucket, which only costs it some extra tasks to look at.
+ */
+void lowmem_adj_index_update(struct task_struct *p)
+{
+	struct task_struct *leader;
+
+	spin_lock(&lowmem_adj_lock);
+	leader = p->group_leader;
+	if (!hlist_unhashed(&leader->lowmem_adj_node)) {
+		hlist_del_init_rcu(&leader->lowmem_adj_node);
+		hlist_add_head_rcu(&leader->lowmem_adj_node,
+				   lowmem_adj_bucket(leader->signal->oom_adj));
+	}
+	spin_unlock(&lowmem_adj_lock);
+}
+
 static int lowmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 {
 	struct task_struct *p;
+	struct hlist_node *pos;
 	struct task_struct *selected = NULL;
 	int rem = 0;
 	int tasksize;
 	int i;
+	int adj;
+	int scanned = 0;
+	ktime_t start;
 	int min_adj = OOM_ADJUST_MAX + 1;
 	int selected_tasksize = 0;
 	int selected_oom_adj;
@@ -131,53 +207,69 @@ static int lowmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 	}
 	selected_oom_adj = min_adj;
 
-	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
+	start = ktime_get();
+	rcu_read_lock();
+	for (adj = OOM_ADJUST_MAX; adj >= min_adj && !selected; adj--) {
+		hlist_for_each_entry_rcu(p, pos, lowmem_adj_bucket(adj),
+					 lowmem_adj_node) {
+			struct mm_struct *mm;
+			struct signal_struct *sig;
+			int oom_adj;
 
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
+			scanned++;
+			task_lock(p);
+			mm = p->mm;
+			sig = p->signal;
+			if (!mm || !sig) {
+				task_unlock(p);
 				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
+			}
+			oom_adj = sig->oom_adj;
+			if (oom_adj < min_adj) {
+				task_unlock(p);
 				continue;
+			}
+			tasksize = get_mm_rss(mm);
+			task_unlock(p);
+			if (tasksize <= 0)
+				continue;
+			if (selected) {
+				if (oom_adj < selected_oom_adj)
+					continue;
+				if (oom_adj == selected_oom_adj &&
+				    tasksize <= selected_tasksize)
+					continue;
+			}
+			selected = p;
+			selected_tasksize = tasksize;
+			selected_oom_adj = oom_adj;
+			lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+				     p->pid, p->comm, oom_adj, tasksize);
 		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
 	}
+	/*
+	 * Without tasklist_lock the selected task may be exiting and have
+	 * lost its sighand already, so pin it and let send_sig() look the
+	 * sighand up under its lock.
+	 */
+	if (selected)
+		get_task_struct(selected);
+	rcu_read_unlock();
+	trace_lowmem_select(min_adj, scanned, selected, selected_oom_adj,
+			    selected_tasksize,
+			    ktime_to_ns(ktime_sub(ktime_get(), start)));
 	if (selected) {
 		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
 			     selected->pid, selected->comm,
 			     selected_oom_adj, selected_tasksize);
 		lowmem_deathpending = selected;
 		lowmem_deathpending_timeout = jiffies + HZ;
-		force_sig(SIGKILL, selected);
+		send_sig(SIGKILL, selected, 0);
+		put_task_struct(selected);
 		rem -= selected_tasksize;
 	}
 	lowmem_print(4, "lowmem_shrink %d, %x, return %d\n",
 		     nr_to_scan, gfp_mask, rem);
-	read_unlock(&tasklist_lock);
 	return rem;
 }
 
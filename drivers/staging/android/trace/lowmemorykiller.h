@@ -0,0 +1,51 @@
+#undef TRACE_SYSTEM
+#define TRACE_INCLUDE_PATH ../../drivers/staging/android/trace
+#define TRACE_SYSTEM lowmemorykiller
+
+#if !defined(_TRACE_LOWMEMORYKILLER_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_LOWMEMORYKILLER_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(lowmem_select,
+
+	TP_PROTO(int min_adj, int scanned, struct task_struct *selected,
+		 int selected_adj, int selected_size, s64 delta_ns),
+
+	TP_ARGS(min_adj, scanned, selected, selected_adj, selected_size,
+		delta_ns),
+
+	TP_STRUCT__entry(
+		__field(int,	min_adj)
+		__field(int,	scanned)
+		__field(pid_t,	pid)
+		__array(char,	comm, TASK_COMM_LEN)
+		__field(int,	adj)
+		__field(int,	size)
+		__field(s64,	delta_ns)
+	),
+
+	TP_fast_assign(
+		__entry->min_adj	= min_adj;
+		__entry->scanned	= scanned;
+		__entry->pid		= selected ? selected->pid : 0;
+		if (selected)
+			memcpy(__entry->comm, selected->comm, TASK_COMM_LEN);
+		else
+			__entry->comm[0] = '\0';
+		__entry->adj		= selected_adj;
+		__entry->size		= selected_size;
+		__entry->delta_ns	= delta_ns;
+	),
+
+	TP_printk("min_adj=%d scanned=%d pid=%d comm=%s adj=%d size=%d "
+		  "latency=%lldns",
+		  __entry->min_adj, __entry->scanned, __entry->pid,
+		  __entry->comm, __entry->adj, __entry->size,
+		  __entry->delta_ns)
+);
+
+#endif /* _TRACE_LOWMEMORYKILLER_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -0,0 +1,238 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/err.h>
+#include <linux/slab.h>
+#include <linux/cpu.h>
+#include <linux/percpu.h>
+
+#include "zcomp.h"
+#include "zcomp_lzo.h"
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+#include "zcomp_lz4.h"
+#endif
+
+static struct zcomp_backend *backends[] = {
+	&zcomp_lzo,
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+	&zcomp_lz4,
+#endif
+	NULL
+};
+
+static struct zcomp_backend *find_backend(const char *compress)
+{
+	int i = 0;
+	while (backends[i]) {
+		if (sysfs_streq(compress, backends[i]->name))
+			break;
+		i++;
+	}
+	return backends[i];
+}
+
+static void zcomp_strm_free(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	if (zstrm->private)
+		comp->backend->destroy(zstrm->private);
+	free_pages((unsigned long)zstrm->buffer, 1);
+	kfree(zstrm);
+}
+
+/*
+ * allocate new zcomp_strm structure with ->private initialized by
+ * backend, return NULL on error
+ */
+static struct zcomp_strm *zcomp_strm_alloc(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm = kzalloc(sizeof(*zstrm), GFP_KERNEL);
+	if (!zstrm)
+		return NULL;
+
+	zstrm->private = comp->backend->create();
+	/*
+	 * allocate 2 pages. 1 for compressed data, plus 1 extra for the
+	 * case when compressed size is larger than the original one
+	 */
+	zstrm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
+	if (!zstrm->private || !zstrm->buffer) {
+		zcomp_strm_free(comp, zstrm);
+		zstrm = NULL;
+	}
+	return zstrm;
+}
+
+static int zcomp_cpu_up(struct zcomp *comp, unsigned int cpu)
+{
+	struct zcomp_strm **zstrm = per_cpu_ptr(comp->stream, cpu);
+
+	if (*zstrm)
+		return 0;
+
+	*zstrm = zcomp_strm_alloc(comp);
+	if (!*zstrm) {
+		pr_err("Can't allocate a compression stream for cpu %u\n",
+			cpu);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static void zcomp_cpu_dead(struct zcomp *comp, unsigned int cpu)
+{
+	struct zcomp_strm **zstrm = per_cpu_ptr(comp->stream, cpu);
+
+	if (*zstrm)
+		zcomp_strm_free(comp, *zstrm);
+	*zstrm = NULL;
+}
+
+static int zcomp_cpu_notifier(struct notifier_block *nb,
+		unsigned long action, void *pcpu)
+{
+	unsigned int cpu = (unsigned long)pcpu;
+	struct zcomp *comp = container_of(nb, struct zcomp, notifier);
+
+	switch (action) {
+	case CPU_UP_PREPARE:
+	case CPU_UP_PREPARE_FROZEN:
+		if (zcomp_cpu_up(comp, cpu))
+			return notifier_from_errno(-ENOMEM);
+		break;
+	case CPU_UP_CANCELED:
+	case CPU_UP_CANCELED_FROZEN:
+	case CPU_DEAD:
+	case CPU_DEAD_FROZEN:
+		zcomp_cpu_dead(comp, cpu);
+		break;
+	default:
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+/* show available compressors */
+ssize_t zcomp_available_show(const char *comp, char *buf)
+{
+	ssize_t sz = 0;
+	int i = 0;
+
+	while (backends[i]) {
+		if (sysfs_streq(comp, backends[i]->name))
+			sz += sprintf(buf + sz, "[%s] ", backends[i]->name);
+		else
+			sz += sprintf(buf + sz, "%s ", backends[i]->name);
+		i++;
+	}
+	sz += sprintf(buf + sz, "\n");
+	return sz;
+}
+
+int zcomp_available_algorithm(const char *comp)
+{
+	return find_backend(comp) != NULL;
+}
+
+/*
+ * Returns this cpu's stream with preemption disabled; the caller must
+ * not sleep until zcomp_strm_release().
+ */
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp)
+{
+	return *get_cpu_ptr(comp->stream);
+}
+
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	put_cpu_ptr(comp->stream);
+}
+
+/* compress PAGE_SIZE bytes at 'src' into zstrm->buffer */
+int zcomp_compress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t *dst_len)
+{
+	return comp->backend->compress(src, zstrm->buffer, dst_len,
+			zstrm->private);
+}
+
+/* decompress 'src_len' bytes at 'src' into one page at 'dst' */
+int zcomp_decompress(struct zcomp *comp, const unsigned char *src,
+		size_t src_len, unsigned char *dst)
+{
+	return comp->backend->decompress(src, src_len, dst);
+}
+
+void zcomp_destroy(struct zcomp *comp)
+{
+	unsigned int cpu;
+
+	unregister_hotcpu_notifier(&comp->notifier);
+	for_each_possible_cpu(cpu)
+		zcomp_cpu_dead(comp, cpu);
+	free_percpu(comp->stream);
+	kfree(comp);
+}
+
+/*
+ * search available compressors for requested algorithm.
+ * allocate new zcomp and initialize it. return compressing
+ * backend pointer or ERR_PTR if things went bad. ERR_PTR(-EINVAL)
+ * if requested algorithm is not supported, ERR_PTR(-ENOMEM) in
+ * case of allocation error.
+ */
+struct zcomp *zcomp_create(const char *compress)
+{
+	struct zcomp *comp;
+	struct zcomp_backend *backend;
+	unsigned int cpu;
+	int ret = 0;
+
+	backend = find_backend(compress);
+	if (!backend)
+		return ERR_PTR(-EINVAL);
+
+	comp = kzalloc(sizeof(struct zcomp), GFP_KERNEL);
+	if (!comp)
+		return ERR_PTR(-ENOMEM);
+
+	comp->backend = backend;
+	comp->stream = alloc_percpu(struct zcomp_strm *);
+	if (!comp->stream) {
+		kfree(comp);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	/*
+	 * Register first so that no cpu coming up is missed; a cpu that is
+	 * brought up concurrently may already have its stream below.
+	 */
+	comp->notifier.notifier_call = zcomp_cpu_notifier;
+	register_hotcpu_notifier(&comp->notifier);
+
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		ret = zcomp_cpu_up(comp, cpu);
+		if (ret)
+			break;
+	}
+	put_online_cpus();
+
+	if (ret) {
+		zcomp_destroy(comp);
+		return ERR_PTR(ret);
+	}
+	return comp;
+}
@@ -17,15 +17,17 @@
 
 #include <linux/module.h>
 #include <linux/kernel.h>
+#include <linux/log2.h>
 #include <linux/bio.h>
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
+#include <linux/err.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
+#include <linux/jhash.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 
@@ -38,14 +40,14 @@ struct zram *devices;
 /* Module params (documentation at end) */
 unsigned int num_devices;
 
-static void zram_stat_inc(u32 *v)
+static void zram_stat_inc(atomic_t *v)
 {
-	*v = *v + 1;
+	atomic_inc(v);
 }
 
-static void zram_stat_dec(u32 *v)
+static void zram_stat_dec(atomic_t *v)
 {
-	*v = *v - 1;
+	atomic_dec(v);
 }
 
 static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
@@ -73,30 +75,25 @@ static int zram_test_flag(struct zram *zram, u32 index,
 	return zram->table[index].flags & BIT(flag);
 }
 
-static void zram_set_flag(struct zram *zram, u32 index,
-			enum zram_pageflags flag)
-{
-	zram->table[index].flags |= BIT(flag);
-}
-
 static void zram_clear_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
 	zram->table[index].flags &= ~BIT(flag);
 }
 
-static int page_zero_filled(void *ptr)
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
 			return 0;
 	}
 
+	*element = page[0];
 	return 1;
 }
 
@@ -129,39 +126,72 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+static void zram_free_obj_stats(struct zram *zram, u32 clen)
+{
+	if (clen <= PAGE_SIZE / 2)
+		zram_stat_dec(&zram->stats.good_compress);
+	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
+}
+
+/*
+ * Drop one reference to a shared object; the object itself goes away
+ * with the last table entry using it.
+ */
+static void zram_dedup_put(struct zram *zram, struct zram_dedup_entry *dentry)
+{
+	spin_lock(&zram->dedup_lock);
+	if (--dentry->refcount) {
+		spin_unlock(&zram->dedup_lock);
+		zram_stat_dec(&zram->stats.pages_dup);
+		return;
+	}
+	hlist_del(&dentry->node);
+	spin_unlock(&zram->dedup_lock);
+
+	zs_free(zram->mem_pool, dentry->handle);
+	zram_free_obj_stats(zram, dentry->len);
+	kfree(dentry);
+}
+
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	u32 clen;
-	void *obj;
-
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	unsigned long handle = zram->table[index].handle;
 
-	if (unlikely(!page)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
+	/*
+	 * No memory is allocated for same filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		if (zram->table[index].element)
+			zram_stat_dec(&zram->stats.pages_same);
+		else
 			zram_stat_dec(&zram->stats.pages_zero);
-		}
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		zram->table[index].element = 0;
 		return;
 	}
 
+	if (unlikely(!handle))
+		return;
+
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		zram_dedup_put(zram, zram->table[index].dentry);
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		zram_stat_dec(&zram->stats.pages_stored);
+		goto out_clear;
+	}
+
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		clen = PAGE_SIZE;
-		__free_page(page);
+		__free_page(zram->table[index].page);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
 		zram_stat_dec(&zram->stats.pages_expand);
 		goto out;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
-
-	xv_free(zram->mem_pool, page, offset);
+	clen = zram->table[index].size;
+	zs_free(zram->mem_pool, handle);
 	if (clen <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
 
@@ -169,16 +199,23 @@ out:
 	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
 	zram_stat_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+out_clear:
+	zram->table[index].handle = 0;
+	zram->table[index].size = 0;
 }
 
-static void handle_zero_page(struct page *page)
+static void handle_same_page(struct page *page, unsigned long element)
 {
-	void *user_mem;
+	unsigned int pos;
+	unsigned long *user_mem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	memset(user_mem, 0, PAGE_SIZE);
+	if (!element) {
+		memset(user_mem, 0, PAGE_SIZE);
+	} else {
+		for (pos = 0; pos != PAGE_SIZE / sizeof(*user_mem); pos++)
+			user_mem[pos] = element;
+	}
 	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
@@ -190,16 +227,75 @@ static void handle_uncompressed_page(struct zram *zram,
 	unsigned char *user_mem, *cmem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
+	cmem = kmap_atomic(zram->table[index].page, KM_USER1);
 
 	memcpy(user_mem, cmem, PAGE_SIZE);
-	kunmap_atomic(user_mem, KM_USER0);
 	kunmap_atomic(cmem, KM_USER1);
+	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
 }
 
+static int zram_bvec_read(struct zram *zram, struct page *page, u32 index)
+{
+	int ret;
+	size_t clen;
+	unsigned long handle;
+	unsigned char *user_mem, *cmem;
+
+	read_lock(&zram->table_lock);
+
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		unsigned long element = zram->table[index].element;
+
+		read_unlock(&zram->table_lock);
+		handle_same_page(page, element);
+		return 0;
+	}
+
+	/* Requested page is not present in compressed area */
+	if (unlikely(!zram->table[index].handle)) {
+		read_unlock(&zram->table_lock);
+		pr_debug("Read before write: page=%u\n", index);
+		handle_same_page(page, 0);
+		return 0;
+	}
+
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		handle_uncompressed_page(zram, page, index);
+		read_unlock(&zram->table_lock);
+		return 0;
+	}
+
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		handle = zram->table[index].dentry->handle;
+		clen = zram->table[index].dentry->len;
+	} else {
+		handle = zram->table[index].handle;
+		clen = zram->table[index].size;
+	}
+
+	user_mem = kmap_atomic(page, KM_USER0);
+	cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
+
+	ret = zcomp_decompress(zram->comp, cmem, clen, user_mem);
+
+	zs_unmap_object(zram->mem_pool, handle);
+	kunmap_atomic(user_mem, KM_USER0);
+	read_unlock(&zram->table_lock);
+
+	/* Should NEVER happen. Return bio error if it does. */
+	if (unlikely(ret)) {
+		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
+		zram_stat64_inc(zram, &zram->stats.failed_reads);
+		return ret;
+	}
+
+	flush_dcache_page(page);
+	return 0;
+}
+
 static int zram_read(struct zram *zram, struct bio *bio)
 {
 
@@ -217,56 +313,8 @@ static int zram_read(struct zram *zram, struct bio *bio)
 	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
 	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		size_t clen;
-		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
-
-		page = bvec->bv_page;
-
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			handle_zero_page(page);
-			continue;
-		}
-
-		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
-			pr_debug("Read before write: sector=%lu, size=%u",
-				(ulong)(bio->bi_sector), bio->bi_size);
-			/* Do nothing */
-			continue;
-		}
-
-		/* Page is stored uncompressed since it's incompressible */
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-			handle_uncompressed_page(zram, page, index);
-			continue;
-		}
-
-		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
-
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
-
-		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
-
-		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
-			pr_err("Decompression failed! err=%d, page=%u\n",
-				ret, index);
-			zram_stat64_inc(zram, &zram->stats.failed_reads);
+		if (zram_bvec_read(zram, bvec->bv_page, index))
 			goto out;
-		}
-
-		flush_dcache_page(page);
 		index++;
 	}
 
@@ -279,125 +327,245 @@ out:
 	return 0;
 }
 
-static int zram_write(struct zram *zram, struct bio *bio)
+/*
+ * Replace whatever is stored at 'index' with the given entry. The old
+ * object, if any, is freed under the same lock so readers never see a
+ * half updated entry.
+ */
+static void zram_table_store(struct zram *zram, u32 index,
+		struct table *entry)
 {
-	int i, ret;
-	u32 index;
-	struct bio_vec *bvec;
+	write_lock(&zram->table_lock);
+	if (zram->table[index].handle ||
+			zram_test_flag(zram, index, ZRAM_SAME))
+		zram_free_page(zram, index);
+	zram->table[index] = *entry;
+	write_unlock(&zram->table_lock);
+}
 
-	if (unlikely(!zram->init_done)) {
-		ret = zram_init_device(zram);
-		if (ret)
-			goto out;
+/*
+ * Look for a stored object with the same compressed contents as 'cbuf'.
+ * On success a reference is taken on the returned entry.
+ */
+static struct zram_dedup_entry *zram_dedup_find(struct zram *zram,
+		const unsigned char *cbuf, size_t clen, u32 checksum)
+{
+	int match;
+	unsigned char *cmem;
+	struct hlist_node *pos;
+	struct zram_dedup_entry *dentry;
+	struct hlist_head *head;
+
+	head = &zram->dedup_hash[checksum & zram->dedup_hash_mask];
+
+	spin_lock(&zram->dedup_lock);
+	hlist_for_each_entry(dentry, pos, head, node) {
+		if (dentry->checksum != checksum || dentry->len != clen)
+			continue;
+
+		cmem = zs_map_object(zram->mem_pool, dentry->handle, ZS_MM_RO);
+		match = !memcmp(cmem, cbuf, clen);
+		zs_unmap_object(zram->mem_pool, dentry->handle);
+
+		if (match) {
+			dentry->refcount++;
+			spin_unlock(&zram->dedup_lock);
+			return dentry;
+		}
 	}
+	spin_unlock(&zram->dedup_lock);
 
-	zram_stat64_inc(zram, &zram->stats.num_writes);
-	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	return NULL;
+}
 
-	bio_for_each_segment(bvec, bio, i) {
-		u32 offset;
-		size_t clen;
-		struct zobj_header *zheader;
-		struct page *page, *page_store;
-		unsigned char *user_mem, *cmem, *src;
+static void zram_dedup_insert(struct zram *zram,
+		struct zram_dedup_entry *dentry)
+{
+	struct hlist_head *head;
 
-		page = bvec->bv_page;
-		src = zram->compress_buffer;
+	head = &zram->dedup_hash[dentry->checksum & zram->dedup_hash_mask];
 
-		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
-		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
+	spin_lock(&zram->dedup_lock);
+	hlist_add_head(&dentry->node, head);
+	spin_unlock(&zram->dedup_lock);
+}
 
-		mutex_lock(&zram->lock);
+static int zram_bvec_write(struct zram *zram, struct page *page, u32 index)
+{
+	int ret;
+	u32 checksum = 0;
+	size_t clen, alloc_len = 0;
+	unsigned long element, handle = 0;
+	struct page *page_store;
+	struct zram_dedup_entry *dentry = NULL, *dup;
+	struct zcomp_strm *zstrm;
+	struct table entry = { };
+	unsigned char *user_mem, *cmem;
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
-			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
+	user_mem = kmap_atomic(page, KM_USER0);
+	if (page_same_filled(user_mem, &element)) {
+		kunmap_atomic(user_mem, KM_USER0);
+		entry.element = element;
+		entry.flags = BIT(ZRAM_SAME);
+		zram_table_store(zram, index, &entry);
+		if (element)
+			zram_stat_inc(&zram->stats.pages_same);
+		else
 			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
-			continue;
-		}
+		return 0;
+	}
+	kunmap_atomic(user_mem, KM_USER0);
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+	/* Allocated here as we cannot sleep while holding the stream */
+	if (zram->use_dedup) {
+		dentry = kmalloc(sizeof(*dentry), GFP_NOIO);
+		if (unlikely(!dentry))
+			return -ENOMEM;
+	}
+
+compress_again:
+	zstrm = zcomp_strm_find(zram->comp);
+	user_mem = kmap_atomic(page, KM_USER0);
+	ret = zcomp_compress(zram->comp, zstrm, user_mem, &clen);
+	kunmap_atomic(user_mem, KM_USER0);
+
+	if (unlikely(ret)) {
+		zcomp_strm_release(zram->comp, zstrm);
+		pr_err("Compression failed! err=%d\n", ret);
+		goto out_free;
+	}
 
+	/*
+	 * Page is incompressible. Store it as-is (uncompressed)
+	 * since we do not want to return too many disk write
+	 * errors which has side effect of hanging the system.
+	 */
+	if (unlikely(clen > max_zpage_size)) {
+		zcomp_strm_release(zram->comp, zstrm);
+		zs_free(zram->mem_pool, handle);
+		kfree(dentry);
+
+		page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
+		if (unlikely(!page_store)) {
+			pr_info("Error allocating memory for "
+				"incompressible page: %u\n", index);
+			return -ENOMEM;
+		}
+
+		user_mem = kmap_atomic(page, KM_USER0);
+		cmem = kmap_atomic(page_store, KM_USER1);
+		memcpy(cmem, user_mem, PAGE_SIZE);
+		kunmap_atomic(cmem, KM_USER1);
 		kunmap_atomic(user_mem, KM_USER0);
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
-			pr_err("Compression failed! err=%d\n", ret);
-			zram_stat64_inc(zram, &zram->stats.failed_writes);
-			goto out;
+		entry.page = page_store;
+		entry.flags = BIT(ZRAM_UNCOMPRESSED);
+		zram_table_store(zram, index, &entry);
+		clen = PAGE_SIZE;
+		zram_stat_inc(&zram->stats.pages_expand);
+		goto update_stats;
+	}
+
+	if (dentry) {
+		checksum = jhash(zstrm->buffer, clen, 0);
+		dup = zram_dedup_find(zram, zstrm->buffer, clen, checksum);
+		if (dup) {
+			zcomp_strm_release(zram->comp, zstrm);
+			zs_free(zram->mem_pool, handle);
+			kfree(dentry);
+
+			entry.dentry = dup;
+			entry.flags = BIT(ZRAM_DEDUP);
+			zram_table_store(zram, index, &entry);
+			zram_stat_inc(&zram->stats.pages_dup);
+			zram_stat_inc(&zram->stats.pages_stored);
+			return 0;
 		}
+	}
+
+	/* The page may have changed since we allocated for it */
+	if (handle && clen > alloc_len) {
+		zs_free(zram->mem_pool, handle);
+		handle = 0;
+	}
 
+	if (!handle) {
+		alloc_len = clen;
 		/*
-		 * Page is incompressible. Store it as-is (uncompressed)
-		 * since we do not want to return too many disk write
-		 * errors which has side effect of hanging the system.
+		 * The stream is held with preemption disabled, so try a
+		 * non-sleeping allocation first. On failure drop the
+		 * stream, allocate with GFP_NOIO and compress again since
+		 * we may come back on a different cpu.
 		 */
-		if (unlikely(clen > max_zpage_size)) {
-			clen = PAGE_SIZE;
-			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
-			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
-				pr_info("Error allocating memory for "
-					"incompressible page: %u\n", index);
-				zram_stat64_inc(zram,
-					&zram->stats.failed_writes);
-				goto out;
+		handle = zs_malloc(zram->mem_pool, clen,
+				GFP_NOWAIT | __GFP_HIGHMEM | __GFP_NOWARN);
+		if (!handle) {
+			zcomp_strm_release(zram->comp, zstrm);
+			handle = zs_malloc(zram->mem_pool, clen,
+					GFP_NOIO | __GFP_HIGHMEM);
+			if (!handle) {
+				pr_info("Error allocating memory for compressed "
+					"page: %u, size=%zu\n", index, clen);
+				ret = -ENOMEM;
+				goto out_free;
 			}
-
-			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
-			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
-		}
-
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
-			pr_info("Error allocating memory for compressed "
-				"page: %u, size=%zu\n", index, clen);
-			zram_stat64_inc(zram, &zram->stats.failed_writes);
-			goto out;
+			goto compress_again;
 		}
+	}
 
-memstore:
-		zram->table[index].offset = offset;
+	cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
+	memcpy(cmem, zstrm->buffer, clen);
+	zs_unmap_object(zram->mem_pool, handle);
+	zcomp_strm_release(zram->comp, zstrm);
+
+	if (dentry) {
+		dentry->handle = handle;
+		dentry->len = clen;
+		dentry->checksum = checksum;
+		dentry->refcount = 1;
+		zram_dedup_insert(zram, dentry);
+
+		entry.dentry = dentry;
+		entry.flags = BIT(ZRAM_DEDUP);
+	} else {
+		entry.handle = handle;
+		entry.size = clen;
+	}
+	zram_table_store(zram, index, &entry);
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+update_stats:
+	zram_stat64_add(zram, &zram->stats.compr_size, clen);
+	zram_stat_inc(&zram->stats.pages_stored);
+	if (clen <= PAGE_SIZE / 2)
+		zram_stat_inc(&zram->stats.good_compress);
+	return 0;
 
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
-		}
-#endif
+out_free:
+	zs_free(zram->mem_pool, handle);
+	kfree(dentry);
+	return ret;
+}
 
-		memcpy(cmem, src, clen);
+static int zram_write(struct zram *zram, struct bio *bio)
+{
+	int i, ret;
+	u32 index;
+	struct bio_vec *bvec;
 
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+	if (unlikely(!zram->init_done)) {
+		ret = zram_init_device(zram);
+		if (ret)
+			goto out;
+	}
 
-		/* Update stats */
-		zram_stat64_add(zram, &zram->stats.compr_size, clen);
-		zram_stat_inc(&zram->stats.pages_stored);
-		if (clen <= PAGE_SIZE / 2)
-			zram_stat_inc(&zram->stats.good_compress);
+	zram_stat64_inc(zram, &zram->stats.num_writes);
+	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
-		mutex_unlock(&zram->lock);
+	bio_for_each_segment(bvec, bio, i) {
+		if (zram_bvec_write(zram, bvec->bv_page, index)) {
+			zram_stat64_inc(zram, &zram->stats.failed_writes);
+			goto out;
+		}
 		index++;
 	}
 
@@ -461,34 +629,46 @@ void zram_reset_device(struct zram *zram)
 	mutex_lock(&zram->init_lock);
 	zram->init_done = 0;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	/* Free the per-cpu compression streams */
+	if (zram->comp)
+		zcomp_destroy(zram->comp);
+	zram->comp = NULL;
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
-
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
+		unsigned long handle = zram->table[index].handle;
 
-		if (!page)
+		/* Shared objects are released from the dedup hash below */
+		if (!handle || zram_test_flag(zram, index, ZRAM_SAME) ||
+				zram_test_flag(zram, index, ZRAM_DEDUP))
 			continue;
 
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
+			__free_page(zram->table[index].page);
 		else
-			xv_free(zram->mem_pool, page, offset);
+			zs_free(zram->mem_pool, handle);
+	}
+
+	if (zram->dedup_hash) {
+		for (index = 0; index <= zram->dedup_hash_mask; index++) {
+			struct hlist_node *pos, *n;
+			struct zram_dedup_entry *dentry;
+
+			hlist_for_each_entry_safe(dentry, pos, n,
+					&zram->dedup_hash[index], node) {
+				zs_free(zram->mem_pool, dentry->handle);
+				kfree(dentry);
+			}
+		}
+		vfree(zram->dedup_hash);
+		zram->dedup_hash = NULL;
 	}
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
 	/* Reset stats */
@@ -501,7 +681,7 @@ void zram_reset_device(struct zram *zram)
 int zram_init_device(struct zram *zram)
 {
 	int ret;
-	size_t num_pages;
+	size_t num_pages, index;
 
 	mutex_lock(&zram->init_lock);
 
@@ -512,20 +692,6 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
 	num_pages = zram->disksize >> PAGE_SHIFT;
 	zram->table = vmalloc(num_pages * sizeof(*zram->table));
 	if (!zram->table) {
@@ -542,13 +708,36 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool(zram->disk->disk_name);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
 		goto fail;
 	}
 
+	if (zram->use_dedup) {
+		zram->dedup_hash_mask = roundup_pow_of_two(
+				max_t(size_t, num_pages >> 4, 64)) - 1;
+		zram->dedup_hash = vmalloc((zram->dedup_hash_mask + 1) *
+				sizeof(*zram->dedup_hash));
+		if (!zram->dedup_hash) {
+			pr_err("Error allocating dedup hash table\n");
+			ret = -ENOMEM;
+			goto fail;
+		}
+		for (index = 0; index <= zram->dedup_hash_mask; index++)
+			INIT_HLIST_HEAD(&zram->dedup_hash[index]);
+	}
+
+	zram->comp = zcomp_create(zram->compressor);
+	if (IS_ERR(zram->comp)) {
+		pr_err("Cannot initialise %s compressing backend\n",
+			zram->compressor);
+		ret = PTR_ERR(zram->comp);
+		zram->comp = NULL;
+		goto fail;
+	}
+
 	zram->init_done = 1;
 	mutex_unlock(&zram->init_lock);
 
@@ -568,7 +757,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	write_lock(&zram->table_lock);
 	zram_free_page(zram, index);
+	write_unlock(&zram->table_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -581,9 +772,12 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	rwlock_init(&zram->table_lock);
+	spin_lock_init(&zram->dedup_lock);
+	strlcpy(zram->compressor, default_compressor,
+		sizeof(zram->compressor));
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
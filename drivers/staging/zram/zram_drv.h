@@ -18,7 +18,8 @@
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
 
-#include "xvmalloc.h"
+#include "zsmalloc.h"
+#include "zcomp.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,18 +27,6 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
@@ -49,11 +38,8 @@ static const unsigned default_disksize_perc_ram = 25;
  */
 static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
-/*
- * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
- */
+/* Compression algorithm used when none is selected via sysfs */
+static const char default_compressor[] = "lzo";
 
 /*-- End of configurable params */
 
@@ -67,18 +53,38 @@ enum zram_pageflags {
 	/* Page is stored uncompressed */
 	ZRAM_UNCOMPRESSED,
 
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/* Page is filled with one repeated word, kept in table.element */
+	ZRAM_SAME,
+
+	/* Compressed object is shared through a zram_dedup_entry */
+	ZRAM_DEDUP,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
+/*
+ * Compressed object shared by all table entries whose compressed
+ * contents are identical. Hashed by checksum in zram->dedup_hash.
+ */
+struct zram_dedup_entry {
+	struct hlist_node node;
+	unsigned long handle;
+	u16 len;		/* compressed length */
+	u32 checksum;
+	int refcount;		/* protected by zram->dedup_lock */
+};
+
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
+	union {
+		unsigned long handle;
+		struct page *page;			/* ZRAM_UNCOMPRESSED */
+		unsigned long element;			/* ZRAM_SAME */
+		struct zram_dedup_entry *dentry;	/* ZRAM_DEDUP */
+	};
+	u16 size;	/* compressed size of the object */
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
 } __attribute__((aligned(4)));
@@ -91,20 +97,21 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 pages_expand;	/* % of incompressible pages */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_same;	/* no. of other single-value pages */
+	atomic_t pages_dup;	/* no. of pages sharing a stored object */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t pages_expand;	/* % of incompressible pages */
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	struct zcomp *comp;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	rwlock_t table_lock;	/* protect table entries; readers decompress
+				 * under it, writers only swap entries */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -115,6 +122,13 @@ struct zram {
 	 * we can store in a disk.
 	 */
 	u64 disksize;	/* bytes */
+	/* compression algorithm, applied at device init */
+	char compressor[10];
+	/* Content based deduplication of compressed pages */
+	int use_dedup;
+	struct hlist_head *dedup_hash;
+	unsigned long dedup_hash_mask;
+	spinlock_t dedup_lock;	/* protect dedup_hash and refcounts */
 
 	struct zram_stats stats;
 };
@@ -0,0 +1,866 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2011  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * Objects are grouped by size into size classes. Each class carves its
+ * objects out of "zspages": up to ZS_MAX_PAGES_PER_ZSPAGE (possibly
+ * highmem) pages treated as one contiguous area, so that an object may
+ * span a page boundary and little space is lost at the end of a page.
+ *
+ * Every object slot starts with a header word. In a free slot it links
+ * to the next free slot of the zspage; in an allocated slot it holds the
+ * handle owning the object. The handle is what users get back: it points
+ * to a word with the object's current location, which lets compaction
+ * move objects from sparsely used zspages into denser ones and release
+ * whole pages without the user noticing. Bit 0 of that word pins the
+ * object while it is mapped or being freed.
+ */
+
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/bit_spinlock.h>
+#include <linux/string.h>
+
+#include "zsmalloc.h"
+
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/*
+ * Class sizes are multiples of this, which keeps every slot header word
+ * aligned and hence within a single page.
+ */
+#define ZS_SIZE_CLASS_DELTA	16
+#define ZS_SIZE_CLASSES	(DIV_ROUND_UP(ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE, \
+					ZS_SIZE_CLASS_DELTA) + 1)
+
+/*
+ * Object location is encoded as <PFN of first zspage page, obj_idx>
+ * and stored shifted left by OBJ_TAG_BITS in the handle word.
+ */
+#ifndef MAX_PHYSMEM_BITS
+#ifdef CONFIG_HIGHMEM64G
+#define MAX_PHYSMEM_BITS	36
+#else
+#define MAX_PHYSMEM_BITS	BITS_PER_LONG
+#endif
+#endif
+#define _PFN_BITS		(MAX_PHYSMEM_BITS - PAGE_SHIFT)
+#define OBJ_TAG_BITS		1
+#define OBJ_INDEX_BITS		(BITS_PER_LONG - _PFN_BITS - OBJ_TAG_BITS)
+#define OBJ_INDEX_MASK		((1UL << OBJ_INDEX_BITS) - 1)
+
+/* Terminates the free slot list of a zspage */
+#define OBJ_FREE_END		OBJ_INDEX_MASK
+
+/* Bit of the handle word used to pin the object in place */
+#define HANDLE_PIN_BIT		0
+
+/* Set in the header of allocated slots; handles are word aligned */
+#define OBJ_ALLOCATED_TAG	1UL
+
+/*
+ * A zspage with at most this many quarters of its slots in use is
+ * "almost empty" and is the first candidate for compaction.
+ */
+#define ZS_ALMOST_EMPTY_QUARTERS	3
+
+enum fullness_group {
+	ZS_ALMOST_EMPTY,
+	ZS_ALMOST_FULL,
+	ZS_FULL,
+	_ZS_NR_FULLNESS_GROUPS,
+
+	/* not on any list: freshly allocated, isolated or to be freed */
+	ZS_EMPTY = _ZS_NR_FULLNESS_GROUPS
+};
+
+struct size_class {
+	spinlock_t lock;
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+	/* slot size, including the header word */
+	int size;
+	int pages_per_zspage;
+	int objs_per_zspage;
+
+	/* protected by lock */
+	unsigned long objs_allocated;	/* slots in all zspages */
+	unsigned long objs_used;
+};
+
+struct zspage {
+	struct list_head list;
+	struct size_class *class;
+	unsigned int inuse;		/* no. of allocated slots */
+	unsigned long freeobj;		/* first free slot */
+	enum fullness_group fullness;
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+};
+
+/* Per-cpu state of the object currently mapped on this cpu */
+struct mapping_area {
+	char *vm_buf;		/* copy of an object spanning two pages */
+	char *vm_addr;		/* kmap address when it doesn't */
+	enum zs_mapmode vm_mm;
+};
+
+struct zs_pool {
+	char *name;
+	struct size_class *size_class[ZS_SIZE_CLASSES];
+	struct kmem_cache *handle_cachep;
+	struct mapping_area __percpu *area;
+
+	atomic_long_t pages_allocated;
+	atomic_long_t pages_compacted;
+
+	struct shrinker shrinker;
+};
+
+static int get_size_class_index(int size)
+{
+	int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				ZS_SIZE_CLASS_DELTA);
+
+	return idx;
+}
+
+/*
+ * Pick the zspage size, in pages, that wastes the smallest fraction of
+ * space at its end for the given slot size.
+ */
+static int get_pages_per_zspage(int class_size)
+{
+	int i, max_usedpc = 0;
+	int max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		int zspage_size = i * PAGE_SIZE;
+		int waste = zspage_size % class_size;
+		int usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+						struct zspage *zspage)
+{
+	if (zspage->inuse == 0)
+		return ZS_EMPTY;
+	if (zspage->inuse == class->objs_per_zspage)
+		return ZS_FULL;
+	if (zspage->inuse * 4 <=
+			class->objs_per_zspage * ZS_ALMOST_EMPTY_QUARTERS)
+		return ZS_ALMOST_EMPTY;
+	return ZS_ALMOST_FULL;
+}
+
+static void insert_zspage(struct size_class *class, struct zspage *zspage,
+				enum fullness_group fullness)
+{
+	zspage->fullness = fullness;
+	if (fullness != ZS_EMPTY)
+		list_add(&zspage->list, &class->fullness_list[fullness]);
+}
+
+static void remove_zspage(struct size_class *class, struct zspage *zspage)
+{
+	if (zspage->fullness != ZS_EMPTY)
+		list_del_init(&zspage->list);
+	zspage->fullness = ZS_EMPTY;
+}
+
+/*
+ * Move the zspage to the list matching its current usage. Returns the
+ * new group; ZS_EMPTY means the zspage should be freed. Caller holds
+ * class->lock.
+ */
+static enum fullness_group fix_fullness_group(struct size_class *class,
+						struct zspage *zspage)
+{
+	enum fullness_group fullness = get_fullness_group(class, zspage);
+
+	if (fullness != zspage->fullness) {
+		remove_zspage(class, zspage);
+		insert_zspage(class, zspage, fullness);
+	}
+
+	return fullness;
+}
+
+/* Prefer the fullest zspages so that sparse ones can drain */
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	struct list_head *head;
+
+	head = &class->fullness_list[ZS_ALMOST_FULL];
+	if (!list_empty(head))
+		return list_first_entry(head, struct zspage, list);
+
+	head = &class->fullness_list[ZS_ALMOST_EMPTY];
+	if (!list_empty(head))
+		return list_first_entry(head, struct zspage, list);
+
+	return NULL;
+}
+
+static unsigned long location_to_obj(struct zspage *zspage,
+					unsigned long obj_idx)
+{
+	return (page_to_pfn(zspage->pages[0]) << OBJ_INDEX_BITS) | obj_idx;
+}
+
+static void obj_to_location(unsigned long obj, struct zspage **zspage,
+				unsigned long *obj_idx)
+{
+	struct page *page = pfn_to_page(obj >> OBJ_INDEX_BITS);
+
+	*zspage = (struct zspage *)page_private(page);
+	*obj_idx = obj & OBJ_INDEX_MASK;
+}
+
+static unsigned long handle_to_obj(unsigned long handle)
+{
+	return *(unsigned long *)handle >> OBJ_TAG_BITS;
+}
+
+/* Update the location of a pinned object, keeping the pin */
+static void record_obj(unsigned long handle, unsigned long obj)
+{
+	*(unsigned long *)handle = (obj << OBJ_TAG_BITS) |
+					BIT(HANDLE_PIN_BIT);
+}
+
+static void pin_tag(unsigned long handle)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static int trypin_tag(unsigned long handle)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static void unpin_tag(unsigned long handle)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+/* Page holding the start of slot 'obj_idx' and the offset within it */
+static struct page *obj_slot(struct size_class *class, struct zspage *zspage,
+				unsigned long obj_idx, unsigned long *offset)
+{
+	unsigned long off = obj_idx * class->size;
+
+	*offset = off & ~PAGE_MASK;
+	return zspage->pages[off >> PAGE_SHIFT];
+}
+
+static unsigned long read_slot_header(struct size_class *class,
+				struct zspage *zspage, unsigned long obj_idx)
+{
+	unsigned long offset, val;
+	struct page *page;
+	void *addr;
+
+	page = obj_slot(class, zspage, obj_idx, &offset);
+	addr = kmap_atomic(page, KM_USER1);
+	val = *(unsigned long *)(addr + offset);
+	kunmap_atomic(addr, KM_USER1);
+
+	return val;
+}
+
+static void write_slot_header(struct size_class *class, struct zspage *zspage,
+				unsigned long obj_idx, unsigned long val)
+{
+	unsigned long offset;
+	struct page *page;
+	void *addr;
+
+	page = obj_slot(class, zspage, obj_idx, &offset);
+	addr = kmap_atomic(page, KM_USER1);
+	*(unsigned long *)(addr + offset) = val;
+	kunmap_atomic(addr, KM_USER1);
+}
+
+/* Copy a whole slot to (to_buf) or from a linear buffer */
+static void copy_slot(struct size_class *class, struct zspage *zspage,
+			unsigned long obj_idx, char *buf, int to_buf)
+{
+	unsigned long off = obj_idx * class->size;
+	int remaining = class->size;
+
+	while (remaining) {
+		struct page *page = zspage->pages[off >> PAGE_SHIFT];
+		unsigned long poff = off & ~PAGE_MASK;
+		int len = min_t(int, remaining, PAGE_SIZE - poff);
+		char *addr;
+
+		addr = kmap_atomic(page, KM_USER1);
+		if (to_buf)
+			memcpy(buf, addr + poff, len);
+		else
+			memcpy(addr + poff, buf, len);
+		kunmap_atomic(addr, KM_USER1);
+
+		buf += len;
+		off += len;
+		remaining -= len;
+	}
+}
+
+/* Copy slot 's_idx' of 's_zspage' over slot 'd_idx' of 'd_zspage' */
+static void copy_object(struct size_class *class,
+			struct zspage *d_zspage, unsigned long d_idx,
+			struct zspage *s_zspage, unsigned long s_idx)
+{
+	unsigned long s_off = s_idx * class->size;
+	unsigned long d_off = d_idx * class->size;
+	int remaining = class->size;
+
+	while (remaining) {
+		struct page *s_page = s_zspage->pages[s_off >> PAGE_SHIFT];
+		struct page *d_page = d_zspage->pages[d_off >> PAGE_SHIFT];
+		unsigned long s_poff = s_off & ~PAGE_MASK;
+		unsigned long d_poff = d_off & ~PAGE_MASK;
+		int len;
+		char *s_addr, *d_addr;
+
+		len = min_t(int, remaining, PAGE_SIZE - s_poff);
+		len = min_t(int, len, PAGE_SIZE - d_poff);
+
+		s_addr = kmap_atomic(s_page, KM_USER0);
+		d_addr = kmap_atomic(d_page, KM_USER1);
+		memcpy(d_addr + d_poff, s_addr + s_poff, len);
+		kunmap_atomic(d_addr, KM_USER1);
+		kunmap_atomic(s_addr, KM_USER0);
+
+		s_off += len;
+		d_off += len;
+		remaining -= len;
+	}
+}
+
+/* Take a free slot from the zspage; caller holds class->lock */
+static unsigned long obj_malloc(struct size_class *class,
+				struct zspage *zspage, unsigned long handle)
+{
+	unsigned long obj_idx = zspage->freeobj;
+
+	zspage->freeobj = read_slot_header(class, zspage, obj_idx) >>
+				OBJ_TAG_BITS;
+	write_slot_header(class, zspage, obj_idx, handle | OBJ_ALLOCATED_TAG);
+
+	zspage->inuse++;
+	class->objs_used++;
+
+	return obj_idx;
+}
+
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			unsigned long obj_idx)
+{
+	write_slot_header(class, zspage, obj_idx,
+			zspage->freeobj << OBJ_TAG_BITS);
+	zspage->freeobj = obj_idx;
+
+	zspage->inuse--;
+	class->objs_used--;
+}
+
+static void free_zspage(struct zs_pool *pool, struct zspage *zspage)
+{
+	struct size_class *class = zspage->class;
+	int i;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		set_page_private(zspage->pages[i], 0);
+		__free_page(zspage->pages[i]);
+	}
+	kfree(zspage);
+
+	atomic_long_sub(class->pages_per_zspage, &pool->pages_allocated);
+}
+
+static struct zspage *alloc_zspage(struct zs_pool *pool,
+				struct size_class *class, gfp_t flags)
+{
+	int i;
+	struct zspage *zspage;
+
+	zspage = kzalloc(sizeof(*zspage), flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		struct page *page = alloc_page(flags);
+
+		if (!page)
+			goto fail;
+		set_page_private(page, (unsigned long)zspage);
+		zspage->pages[i] = page;
+	}
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class = class;
+	zspage->fullness = ZS_EMPTY;
+
+	/* Link all slots into the free list */
+	for (i = 0; i < class->objs_per_zspage; i++) {
+		unsigned long next = i + 1;
+
+		if (next == class->objs_per_zspage)
+			next = OBJ_FREE_END;
+		write_slot_header(class, zspage, i, next << OBJ_TAG_BITS);
+	}
+	zspage->freeobj = 0;
+
+	atomic_long_add(class->pages_per_zspage, &pool->pages_allocated);
+	return zspage;
+
+fail:
+	while (i--) {
+		set_page_private(zspage->pages[i], 0);
+		__free_page(zspage->pages[i]);
+	}
+	kfree(zspage);
+	return NULL;
+}
+
+/**
+ * zs_malloc - Allocate block of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ * @flags: gfp flags used when the pool has to grow
+ *
+ * On success, handle to the allocated object is returned,
+ * otherwise 0.
+ * Allocation requests with size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * will fail.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t flags)
+{
+	unsigned long handle, obj_idx;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE))
+		return 0;
+
+	handle = (unsigned long)kmem_cache_alloc(pool->handle_cachep,
+						flags & ~__GFP_HIGHMEM);
+	if (!handle)
+		return 0;
+
+	class = pool->size_class[get_size_class_index(size + ZS_HANDLE_SIZE)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(pool, class, flags);
+		if (unlikely(!zspage)) {
+			kmem_cache_free(pool->handle_cachep, (void *)handle);
+			return 0;
+		}
+
+		spin_lock(&class->lock);
+		class->objs_allocated += class->objs_per_zspage;
+	}
+
+	obj_idx = obj_malloc(class, zspage, handle);
+	/* Set under the lock, before compaction can find the object */
+	*(unsigned long *)handle = location_to_obj(zspage, obj_idx) <<
+					OBJ_TAG_BITS;
+	fix_fullness_group(class, zspage);
+	spin_unlock(&class->lock);
+
+	return handle;
+}
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	unsigned long obj_idx;
+	struct size_class *class;
+	struct zspage *zspage;
+	enum fullness_group fullness;
+
+	if (unlikely(!handle))
+		return;
+
+	/* Keeps compaction from moving the object under us */
+	pin_tag(handle);
+	obj_to_location(handle_to_obj(handle), &zspage, &obj_idx);
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	obj_free(class, zspage, obj_idx);
+	fullness = fix_fullness_group(class, zspage);
+	if (fullness == ZS_EMPTY)
+		class->objs_allocated -= class->objs_per_zspage;
+	spin_unlock(&class->lock);
+	unpin_tag(handle);
+
+	if (fullness == ZS_EMPTY)
+		free_zspage(pool, zspage);
+
+	kmem_cache_free(pool->handle_cachep, (void *)handle);
+}
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @handle: handle returned from zs_malloc
+ * @mm: how the object will be accessed
+ *
+ * Before using an object allocated from zs_malloc, it must be mapped
+ * using this function. When done with the object, it must be unmapped
+ * using zs_unmap_object.
+ *
+ * Only one object can be mapped per cpu at a time. Preemption is
+ * disabled, and the object cannot be moved, until it is unmapped.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm)
+{
+	unsigned long obj_idx, offset;
+	struct size_class *class;
+	struct zspage *zspage;
+	struct mapping_area *area;
+	struct page *page;
+
+	BUG_ON(!handle);
+
+	pin_tag(handle);
+	obj_to_location(handle_to_obj(handle), &zspage, &obj_idx);
+	class = zspage->class;
+	page = obj_slot(class, zspage, obj_idx, &offset);
+
+	area = this_cpu_ptr(pool->area);
+	area->vm_mm = mm;
+	if (offset + class->size <= PAGE_SIZE) {
+		/* this object is contained entirely within a page */
+		area->vm_addr = kmap_atomic(page, KM_USER1);
+		return area->vm_addr + offset + ZS_HANDLE_SIZE;
+	}
+
+	/*
+	 * The object spans two pages: work on a copy. The header is
+	 * copied back at unmap time, so it is read in even for ZS_MM_WO.
+	 */
+	area->vm_addr = NULL;
+	copy_slot(class, zspage, obj_idx, area->vm_buf, 1);
+	return area->vm_buf + ZS_HANDLE_SIZE;
+}
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	unsigned long obj_idx;
+	struct zspage *zspage;
+	struct mapping_area *area;
+
+	BUG_ON(!handle);
+
+	area = this_cpu_ptr(pool->area);
+	if (area->vm_addr) {
+		kunmap_atomic(area->vm_addr, KM_USER1);
+	} else if (area->vm_mm != ZS_MM_RO) {
+		obj_to_location(handle_to_obj(handle), &zspage, &obj_idx);
+		copy_slot(zspage->class, zspage, obj_idx, area->vm_buf, 0);
+	}
+	unpin_tag(handle);
+}
+
+/* No. of zspages of this class that compaction could release */
+static unsigned long zs_can_compact(struct size_class *class)
+{
+	return (class->objs_allocated - class->objs_used) /
+			class->objs_per_zspage;
+}
+
+/*
+ * Move the objects of an isolated zspage into other zspages of the
+ * class. Returns 0 once the zspage is empty, or -EBUSY if an object is
+ * pinned or there is no room left elsewhere. Caller holds class->lock.
+ */
+static int migrate_zspage(struct size_class *class, struct zspage *src)
+{
+	unsigned long s_idx, d_idx, header, handle;
+	struct zspage *dst;
+
+	for (s_idx = 0; s_idx < class->objs_per_zspage && src->inuse;
+			s_idx++) {
+		header = read_slot_header(class, src, s_idx);
+		if (!(header & OBJ_ALLOCATED_TAG))
+			continue;
+
+		handle = header & ~OBJ_ALLOCATED_TAG;
+		dst = find_get_zspage(class);
+		if (!dst || !trypin_tag(handle))
+			return -EBUSY;
+
+		d_idx = obj_malloc(class, dst, handle);
+		copy_object(class, dst, d_idx, src, s_idx);
+		record_obj(handle, location_to_obj(dst, d_idx));
+		unpin_tag(handle);
+
+		obj_free(class, src, s_idx);
+		fix_fullness_group(class, dst);
+	}
+
+	return 0;
+}
+
+static unsigned long zs_compact_class(struct zs_pool *pool,
+					struct size_class *class)
+{
+	unsigned long pages_freed = 0;
+	struct list_head *head = &class->fullness_list[ZS_ALMOST_EMPTY];
+	struct zspage *src;
+	int ret;
+
+	while (1) {
+		spin_lock(&class->lock);
+		if (!zs_can_compact(class) || list_empty(head)) {
+			spin_unlock(&class->lock);
+			break;
+		}
+
+		/* The least recently filled sparse zspage is drained first */
+		src = list_entry(head->prev, struct zspage, list);
+		remove_zspage(class, src);
+
+		ret = migrate_zspage(class, src);
+		if (src->inuse == 0) {
+			class->objs_allocated -= class->objs_per_zspage;
+			spin_unlock(&class->lock);
+			free_zspage(pool, src);
+			pages_freed += class->pages_per_zspage;
+		} else {
+			insert_zspage(class, src,
+					get_fullness_group(class, src));
+			spin_unlock(&class->lock);
+		}
+
+		if (ret)
+			break;
+		cond_resched();
+	}
+
+	return pages_freed;
+}
+
+/**
+ * zs_compact - release pages by packing objects into fewer zspages
+ * @pool: pool to compact
+ *
+ * Returns the number of pages freed. May sleep.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	int i;
+	unsigned long pages_freed = 0;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--)
+		pages_freed += zs_compact_class(pool, pool->size_class[i]);
+
+	atomic_long_add(pages_freed, &pool->pages_compacted);
+	return pages_freed;
+}
+
+static unsigned long zs_freeable_pages(struct zs_pool *pool)
+{
+	int i;
+	unsigned long pages = 0;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = pool->size_class[i];
+
+		pages += zs_can_compact(class) * class->pages_per_zspage;
+	}
+
+	return pages;
+}
+
+/*
+ * Compact in the background whenever the VM is short on memory. The
+ * object count is the no. of pages compaction could release.
+ */
+static int zs_shrinker_shrink(struct shrinker *shrinker, int nr_to_scan,
+				gfp_t gfp_mask)
+{
+	struct zs_pool *pool = container_of(shrinker, struct zs_pool,
+						shrinker);
+
+	if (nr_to_scan) {
+		if (!(gfp_mask & __GFP_WAIT))
+			return -1;
+		zs_compact(pool);
+	}
+
+	return min_t(unsigned long, zs_freeable_pages(pool), INT_MAX);
+}
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+
+void zs_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
+{
+	int i;
+
+	stats->pages_compacted = atomic_long_read(&pool->pages_compacted);
+	stats->obj_used_bytes = 0;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = pool->size_class[i];
+
+		spin_lock(&class->lock);
+		stats->obj_used_bytes += (u64)class->objs_used * class->size;
+		spin_unlock(&class->lock);
+	}
+}
+
+static void zs_free_area(struct zs_pool *pool)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		free_page((unsigned long)per_cpu_ptr(pool->area, cpu)->vm_buf);
+	free_percpu(pool->area);
+}
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i, fg;
+
+	if (pool->shrinker.shrink)
+		unregister_shrinker(&pool->shrinker);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = pool->size_class[i];
+
+		if (!class)
+			continue;
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			if (!list_empty(&class->fullness_list[fg]))
+				pr_info("Freeing non-empty class with size "
+					"%db, fullness group %d\n",
+					class->size, fg);
+		}
+		kfree(class);
+	}
+
+	if (pool->area)
+		zs_free_area(pool);
+	if (pool->handle_cachep)
+		kmem_cache_destroy(pool->handle_cachep);
+	kfree(pool->name);
+	kfree(pool);
+}
+
+/**
+ * zs_create_pool - Creates an allocation pool to work from.
+ * @name: pool name, used to name the handle cache
+ *
+ * This function must be called before anything when using
+ * the zsmalloc allocator.
+ *
+ * On success, a pointer to the newly created pool is returned,
+ * otherwise NULL.
+ */
+struct zs_pool *zs_create_pool(const char *name)
+{
+	int i, cpu;
+	struct zs_pool *pool;
+
+	BUILD_BUG_ON(ZS_MAX_PAGES_PER_ZSPAGE * PAGE_SIZE / ZS_MIN_ALLOC_SIZE >=
+			OBJ_FREE_END);
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	pool->name = kasprintf(GFP_KERNEL, "zs_handle-%s", name);
+	if (!pool->name)
+		goto err;
+
+	pool->handle_cachep = kmem_cache_create(pool->name, ZS_HANDLE_SIZE,
+						0, 0, NULL);
+	if (!pool->handle_cachep)
+		goto err;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class;
+
+		class = kzalloc(sizeof(*class), GFP_KERNEL);
+		if (!class)
+			goto err;
+
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		if (class->size > ZS_MAX_ALLOC_SIZE)
+			class->size = ZS_MAX_ALLOC_SIZE;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage *
+						PAGE_SIZE / class->size;
+		spin_lock_init(&class->lock);
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+
+		pool->size_class[i] = class;
+	}
+
+	pool->area = alloc_percpu(struct mapping_area);
+	if (!pool->area)
+		goto err;
+
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = per_cpu_ptr(pool->area, cpu);
+
+		area->vm_buf = (char *)__get_free_page(GFP_KERNEL);
+		if (!area->vm_buf)
+			goto err;
+	}
+
+	pool->shrinker.shrink = zs_shrinker_shrink;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
+	return pool;
+
+err:
+	zs_destroy_pool(pool);
+	return NULL;
+}
@@ -387,6 +387,8 @@ int bprm_mm_init(struct linux_binprm *bprm)
 	if (err)
 		goto err;
 
+	/* from here on the mm is released with mmput() */
+	lru_gen_add_mm(mm);
 	return 0;
 
 err:
@@ -908,6 +910,8 @@ static int de_thread(struct task_struct *tsk)
 		transfer_pid(leader, tsk, PIDTYPE_SID);
 
 		list_replace_rcu(&leader->tasks, &tsk->tasks);
+		lowmem_adj_index_del(leader);
+		lowmem_adj_index_add(tsk);
 		list_replace_init(&leader->sibling, &tsk->sibling);
 
 		tsk->group_leader = tsk;
@@ -264,6 +264,21 @@ static inline void ptep_modify_prot_commit(struct mm_struct *mm,
 	__ptep_modify_prot_commit(mm, addr, ptep, pte);
 }
 #endif /* __HAVE_ARCH_PTEP_MODIFY_PROT_TRANSACTION */
+
+#ifndef CONFIG_TRANSPARENT_HUGEPAGE
+static inline int pmd_trans_huge(pmd_t pmd)
+{
+	return 0;
+}
+#endif
+
+#ifndef CONFIG_NUMA_BALANCING
+static inline int pte_numa(pte_t pte)
+{
+	return 0;
+}
+#endif
+
 #endif /* CONFIG_MMU */
 
 /*
@@ -106,6 +106,8 @@ struct vm_area_struct;
 				 __GFP_HARDWALL | __GFP_HIGHMEM | \
 				 __GFP_MOVABLE)
 #define GFP_IOFS	(__GFP_IO | __GFP_FS)
+#define GFP_TRANSHUGE	(GFP_HIGHUSER_MOVABLE | __GFP_COMP | \
+			 __GFP_NOMEMALLOC | __GFP_NORETRY | __GFP_NOWARN)
 
 #ifdef CONFIG_NUMA
 #define GFP_THISNODE	(__GFP_THISNODE | __GFP_NOWARN | __GFP_NORETRY)
@@ -309,6 +311,51 @@ static inline struct page *alloc_pages_node(int nid, gfp_t gfp_mask,
 	return __alloc_pages(gfp_mask, order, node_zonelist(nid, gfp_mask));
 }
 
+unsigned long __alloc_pages_bulk_nodemask(gfp_t gfp_mask,
+					  struct zonelist *zonelist,
+					  nodemask_t *nodemask,
+					  unsigned long nr_pages,
+					  struct list_head *page_list,
+					  struct page **page_array);
+
+/*
+ * Allocate up to nr_pages order-0 pages from node nid (or the current
+ * node if nid is negative) onto page_list. Returns the number of pages
+ * that were added, which may be less than requested.
+ */
+static inline unsigned long
+alloc_pages_bulk_list_node(int nid, gfp_t gfp_mask, unsigned long nr_pages,
+			   struct list_head *page_list)
+{
+	if (nid < 0)
+		nid = numa_node_id();
+
+	return __alloc_pages_bulk_nodemask(gfp_mask, node_zonelist(nid, gfp_mask),
+					   NULL, nr_pages, page_list, NULL);
+}
+
+/*
+ * Fill the NULL entries of page_array[0..nr_pages-1] with order-0 pages
+ * from node nid (or the current node if nid is negative). Entries that
+ * are already set are skipped. Returns the number of leading entries
+ * that are populated afterwards.
+ */
+static inline unsigned long
+alloc_pages_bulk_array_node(int nid, gfp_t gfp_mask, unsigned long nr_pages,
+			    struct page **page_array)
+{
+	if (nid < 0)
+		nid = numa_node_id();
+
+	return __alloc_pages_bulk_nodemask(gfp_mask, node_zonelist(nid, gfp_mask),
+					   NULL, nr_pages, NULL, page_array);
+}
+
+#define alloc_pages_bulk_list(gfp_mask, nr_pages, page_list)		\
+	alloc_pages_bulk_list_node(-1, gfp_mask, nr_pages, page_list)
+#define alloc_pages_bulk_array(gfp_mask, nr_pages, page_array)		\
+	alloc_pages_bulk_array_node(-1, gfp_mask, nr_pages, page_array)
+
 static inline struct page *alloc_pages_exact_node(int nid, gfp_t gfp_mask,
 						unsigned int order)
 {
@@ -325,13 +372,16 @@ alloc_pages(gfp_t gfp_mask, unsigned int order)
 {
 	return alloc_pages_current(gfp_mask, order);
 }
-extern struct page *alloc_page_vma(gfp_t gfp_mask,
+extern struct page *alloc_pages_vma(gfp_t gfp_mask, int order,
 			struct vm_area_struct *vma, unsigned long addr);
 #else
 #define alloc_pages(gfp_mask, order) \
 		alloc_pages_node(numa_node_id(), gfp_mask, order)
-#define alloc_page_vma(gfp_mask, vma, addr) alloc_pages(gfp_mask, 0)
+#define alloc_pages_vma(gfp_mask, order, vma, addr)	\
+	alloc_pages(gfp_mask, order)
 #endif
+#define alloc_page_vma(gfp_mask, vma, addr)		\
+	alloc_pages_vma(gfp_mask, 0, vma, addr)
 #define alloc_page(gfp_mask) alloc_pages(gfp_mask, 0)
 
 extern unsigned long __get_free_pages(gfp_t gfp_mask, unsigned int order);
@@ -0,0 +1,137 @@
+#ifndef _LINUX_HUGE_MM_H
+#define _LINUX_HUGE_MM_H
+
+/*
+ * Transparent huge pages: anonymous memory backed by pmd-sized pages
+ * without any help from hugetlbfs. See mm/huge_memory.c.
+ */
+
+struct mmu_gather;
+
+extern int do_huge_pmd_anonymous_page(struct mm_struct *mm,
+				      struct vm_area_struct *vma,
+				      unsigned long address, pmd_t *pmd,
+				      unsigned int flags);
+extern int do_huge_pmd_file_page(struct vm_area_struct *vma,
+				 unsigned long haddr, pmd_t *pmd,
+				 struct page *page);
+extern struct page *follow_trans_huge_pmd(struct mm_struct *mm,
+					  unsigned long addr,
+					  pmd_t *pmd,
+					  unsigned int flags);
+extern int zap_huge_pmd(struct mmu_gather *tlb,
+			struct vm_area_struct *vma,
+			pmd_t *pmd);
+extern int mincore_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
+			    unsigned long addr, unsigned long end,
+			    unsigned char *vec);
+extern pmd_t *trans_huge_pmd_offset(struct mm_struct *mm,
+				    unsigned long address);
+extern pmd_t *page_check_address_pmd(struct page *page,
+				     struct mm_struct *mm,
+				     unsigned long address);
+
+enum transparent_hugepage_flag {
+	TRANSPARENT_HUGEPAGE_FLAG,
+	TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+	TRANSPARENT_HUGEPAGE_DEFRAG_FLAG,
+	TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG,
+	TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG,
+};
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#define HPAGE_PMD_SHIFT PMD_SHIFT
+#define HPAGE_PMD_SIZE	((1UL) << HPAGE_PMD_SHIFT)
+#define HPAGE_PMD_MASK	(~(HPAGE_PMD_SIZE - 1))
+#define HPAGE_PMD_ORDER (HPAGE_PMD_SHIFT - PAGE_SHIFT)
+#define HPAGE_PMD_NR	(1 << HPAGE_PMD_ORDER)
+
+extern unsigned long transparent_hugepage_flags;
+
+/*
+ * VM_HUGEPAGE is only looked at in "madvise" mode: in "always" mode
+ * every suitable vma qualifies, in "never" mode none does.
+ */
+#define transparent_hugepage_enabled(__vma)				\
+	((transparent_hugepage_flags &					\
+	  (1 << TRANSPARENT_HUGEPAGE_FLAG)) ||				\
+	 ((transparent_hugepage_flags &					\
+	   (1 << TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG)) &&		\
+	  ((__vma)->vm_flags & VM_HUGEPAGE)))
+#define transparent_hugepage_defrag(__vma)				\
+	((transparent_hugepage_flags &					\
+	  (1 << TRANSPARENT_HUGEPAGE_DEFRAG_FLAG)) ||			\
+	 ((transparent_hugepage_flags &					\
+	   (1 << TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG)) &&		\
+	  ((__vma)->vm_flags & VM_HUGEPAGE)))
+
+extern int split_huge_page(struct page *page);
+extern void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd);
+#define split_huge_page_pmd(__mm, __pmd)				\
+	do {								\
+		pmd_t *____pmd = (__pmd);				\
+		if (unlikely(pmd_trans_huge(*____pmd)))			\
+			__split_huge_page_pmd(__mm, ____pmd);		\
+	} while (0)
+extern void split_huge_file_pmd_address(struct vm_area_struct *vma,
+					unsigned long address);
+extern void split_huge_file_pmds(struct vm_area_struct *vma);
+
+/*
+ * Only valid for pages found on the anon LRU or through an anon pte or
+ * pmd: no other compound page is ever put there.
+ */
+static inline int PageTransHuge(struct page *page)
+{
+	VM_BUG_ON(PageTail(page));
+	return PageHead(page);
+}
+
+static inline int hpage_nr_pages(struct page *page)
+{
+	if (unlikely(PageTransHuge(page)))
+		return HPAGE_PMD_NR;
+	return 1;
+}
+
+extern int hugepage_madvise(struct vm_area_struct *vma,
+			    unsigned long *vm_flags);
+#else /* CONFIG_TRANSPARENT_HUGEPAGE */
+#define HPAGE_PMD_SHIFT ({ BUG(); 0; })
+#define HPAGE_PMD_MASK ({ BUG(); 0; })
+#define HPAGE_PMD_SIZE ({ BUG(); 0; })
+#define HPAGE_PMD_NR ({ BUG(); 0; })
+
+#define transparent_hugepage_enabled(__vma) 0
+#define transparent_hugepage_defrag(__vma) 0
+
+static inline int split_huge_page(struct page *page)
+{
+	return 0;
+}
+#define split_huge_page_pmd(__mm, __pmd)	\
+	do { } while (0)
+static inline void split_huge_file_pmd_address(struct vm_area_struct *vma,
+					       unsigned long address)
+{
+}
+static inline void split_huge_file_pmds(struct vm_area_struct *vma)
+{
+}
+
+static inline int PageTransHuge(struct page *page)
+{
+	return 0;
+}
+
+#define hpage_nr_pages(x) 1
+
+static inline int hugepage_madvise(struct vm_area_struct *vma,
+				   unsigned long *vm_flags)
+{
+	BUG();
+	return 0;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
+#endif /* _LINUX_HUGE_MM_H */
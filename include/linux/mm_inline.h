@@ -19,11 +19,73 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
+#ifdef CONFIG_LRU_GEN
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+static inline int lru_gen_zone_enabled(struct zone *zone)
+{
+	return zone->lrugen.enabled;
+}
+#else
+static inline int lru_gen_zone_enabled(struct zone *zone)
+{
+	return 0;
+}
+#endif
+
+/**
+ * zone_lru_list - the list head a page on LRU list @l is added to
+ * @zone: the zone the page belongs to
+ * @l: the LRU list the page is accounted to
+ *
+ * With the multi-generational LRU enabled in @zone, active pages go to
+ * the youngest generation and inactive ones to the second oldest, so
+ * that they get one round of aging before they can be evicted.
+ * Must be called with the zone's lru_lock held.
+ */
+static inline struct list_head *zone_lru_list(struct zone *zone,
+					      enum lru_list l)
+{
+#ifdef CONFIG_LRU_GEN
+	if (lru_gen_zone_enabled(zone) && !is_unevictable_lru(l)) {
+		unsigned long max_seq = ACCESS_ONCE(lru_gen_max_seq);
+		unsigned long seq = max_seq;
+		int file = is_file_lru(l);
+
+		if (!is_active_lru(l))
+			seq = min(zone->lrugen.min_seq[file] + 1, max_seq);
+		return &zone->lrugen.lists[lru_gen_from_seq(seq)][file];
+	}
+#endif
+	return &zone->lru[l].list;
+}
+
+/*
+ * The list reclaim takes pages of LRU list @l from: with generations,
+ * the oldest one of the type. Must be called with lru_lock held.
+ */
+static inline struct list_head *zone_lru_evict_list(struct zone *zone,
+						    enum lru_list l)
+{
+#ifdef CONFIG_LRU_GEN
+	if (lru_gen_zone_enabled(zone) && !is_unevictable_lru(l)) {
+		int file = is_file_lru(l);
+		unsigned long seq = zone->lrugen.min_seq[file];
+
+		return &zone->lrugen.lists[lru_gen_from_seq(seq)][file];
+	}
+#endif
+	return &zone->lru[l].list;
+}
+
 static inline void
 add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
-	list_add(&page->lru, &zone->lru[l].list);
-	__inc_zone_state(zone, NR_LRU_BASE + l);
+	list_add(&page->lru, zone_lru_list(zone, l));
+	__mod_zone_page_state(zone, NR_LRU_BASE + l, hpage_nr_pages(page));
 	mem_cgroup_add_lru_list(page, l);
 }
 
@@ -31,7 +93,7 @@ static inline void
 del_page_from_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
 	list_del(&page->lru);
-	__dec_zone_state(zone, NR_LRU_BASE + l);
+	__mod_zone_page_state(zone, NR_LRU_BASE + l, -hpage_nr_pages(page));
 	mem_cgroup_del_lru_list(page, l);
 }
 
@@ -66,7 +128,7 @@ del_page_from_lru(struct zone *zone, struct page *page)
 			l += LRU_ACTIVE;
 		}
 	}
-	__dec_zone_state(zone, NR_LRU_BASE + l);
+	__mod_zone_page_state(zone, NR_LRU_BASE + l, -hpage_nr_pages(page));
 	mem_cgroup_del_lru_list(page, l);
 }
 
@@ -21,6 +21,7 @@
 #define AT_VECTOR_SIZE (2*(AT_VECTOR_SIZE_ARCH + AT_VECTOR_SIZE_BASE + 1))
 
 struct address_space;
+struct futex_hash_bucket;
 
 #define USE_SPLIT_PTLOCKS	(NR_CPUS >= CONFIG_SPLIT_PTLOCK_CPUS)
 
@@ -72,9 +73,21 @@ struct page {
 		pgoff_t index;		/* Our offset within mapping. */
 		void *freelist;		/* SLUB: freelist req. slab lock */
 	};
-	struct list_head lru;		/* Pageout list, eg. active_list
+	union {
+		struct list_head lru;	/* Pageout list, eg. active_list
 					 * protected by zone->lru_lock !
 					 */
+		struct {		/* SLUB per cpu partial pages */
+			struct page *next;	/* Next partial slab */
+#ifdef CONFIG_64BIT
+			int pages;	/* Nr of partial slabs left */
+			int pobjects;	/* Approximate # of objects */
+#else
+			short int pages;
+			short int pobjects;
+#endif
+		};
+	};
 	/*
 	 * On machines where all RAM is mapped into kernel address space,
 	 * we can simply calculate the virtual address. On machines with
@@ -180,6 +193,9 @@ struct vm_area_struct {
 #ifndef CONFIG_MMU
 	struct vm_region *vm_region;	/* NOMMU mapping region */
 #endif
+#ifdef CONFIG_SWAP
+	atomic_long_t swap_readahead_info; /* last fault, window, hits */
+#endif
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
@@ -312,6 +328,27 @@ struct mm_struct {
 #endif
 	/* How many tasks sharing this mm are OOM_DISABLE */
 	atomic_t oom_disable_count;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	pgtable_t pmd_huge_pte; /* protected by page_table_lock */
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+	/* jiffies when the next NUMA hinting scan of this mm is due */
+	unsigned long numa_next_scan;
+	/* where the next scan picks up; numa_scan_seq counts full passes */
+	unsigned long numa_scan_offset;
+	int numa_scan_seq;
+#endif
+#ifdef CONFIG_LRU_GEN
+	/* on the list of mms whose page tables are walked for aging */
+	struct list_head lru_gen_list;
+	/* the generation its page tables were last walked for */
+	unsigned long lru_gen_seq;
+#endif
+#ifdef CONFIG_FUTEX
+	/* private hash for PROCESS_PRIVATE futexes, see PR_SET_FUTEX_HASH */
+	struct futex_hash_bucket *futex_queues;
+	unsigned long futex_hashsize;
+#endif
 };
 
 /* Future-safe accessor for struct mm_struct's cpu_vm_mask. */
@@ -106,6 +106,7 @@ enum zone_stat_item {
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
 	NR_DIRTIED,		/* page dirtyings since bootup */
 	NR_WRITTEN,		/* page writings since bootup */
+	NR_ANON_TRANSPARENT_HUGEPAGES,
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -279,6 +280,31 @@ struct zone_reclaim_stat {
 	unsigned long		nr_saved_scan[NR_LRU_LISTS];
 };
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-generational LRU sorts the evictable pages of a zone by age
+ * instead of by active/inactive: pages found young in the page tables
+ * move to the youngest generation, reclaim evicts from the oldest one.
+ * Generations are numbered by a sequence counter that is shared by all
+ * zones, each zone keeps the oldest generation it still has pages in.
+ * See mm/lru_gen.c.
+ */
+#define MIN_NR_GENS	2
+#define MAX_NR_GENS	4
+
+struct lru_gen {
+	/* Set under lru_lock when the zone's pages are on the lists below */
+	int			enabled;
+	/* Oldest generation per type: anon in [0], file in [1] */
+	unsigned long		min_seq[2];
+	/* Indexed by sequence number modulo MAX_NR_GENS, then by type */
+	struct list_head	lists[MAX_NR_GENS][2];
+};
+
+/* The youngest generation, protected by lru_gen_mutex */
+extern unsigned long lru_gen_max_seq;
+#endif
+
 struct zone {
 	/* Fields commonly accessed by the page allocator */
 
@@ -349,6 +375,9 @@ struct zone {
 	} lru[NR_LRU_LISTS];
 
 	struct zone_reclaim_stat reclaim_stat;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen		lrugen;
+#endif
 
 	unsigned long		pages_scanned;	   /* since last reclaim */
 	unsigned long		flags;		   /* zone flags, see below */
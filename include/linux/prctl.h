@@ -102,4 +102,12 @@
 
 #define PR_MCE_KILL_GET 34
 
+/*
+ * Give the process its own hash table for PROCESS_PRIVATE futexes, with
+ * the given number of buckets (0 picks one from the number of CPUs).
+ * Only allowed while the process is single threaded.
+ */
+#define PR_SET_FUTEX_HASH 35
+#define PR_GET_FUTEX_HASH 36
+
 #endif /* _LINUX_PRCTL_H */
@@ -224,6 +224,11 @@ static inline pte_t *page_check_address(struct page *page, struct mm_struct *mm,
  */
 unsigned long page_address_in_vma(struct page *, struct vm_area_struct *);
 
+/*
+ * Where the page's index says it is mapped in the vma, -EFAULT if outside.
+ */
+unsigned long vma_address(struct page *, struct vm_area_struct *);
+
 /*
  * Cleans the PTEs of shared mappings.
  * (and since clean PTEs should also be readonly, write protects them too)
@@ -32,6 +32,7 @@ struct shmem_sb_info {
 	gid_t gid;		    /* Mount gid for root directory */
 	mode_t mode;		    /* Mount mode for root directory */
 	struct mempolicy *mpol;     /* default memory policy for mappings */
+	bool huge;		    /* Map files with huge pmds (huge=always) */
 };
 
 static inline struct shmem_inode_info *SHMEM_I(struct inode *inode)
@@ -104,6 +104,18 @@ struct kmem_cache *kmem_cache_create(const char *, size_t, size_t,
 void kmem_cache_destroy(struct kmem_cache *);
 int kmem_cache_shrink(struct kmem_cache *);
 void kmem_cache_free(struct kmem_cache *, void *);
+
+/*
+ * Bulk allocation and freeing of objects of a single cache. Cheaper than
+ * calling kmem_cache_alloc() or kmem_cache_free() in a loop since the
+ * per cpu state is only set up once for the whole batch.
+ *
+ * kmem_cache_alloc_bulk() is all or nothing: it returns the number of
+ * objects stored in p (i.e. nr) on success or 0 if not all of them could
+ * be allocated, in which case nothing needs to be freed.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *, gfp_t, size_t, void **);
+void kmem_cache_free_bulk(struct kmem_cache *, size_t, void **);
 unsigned int kmem_cache_size(struct kmem_cache *);
 const char *kmem_cache_name(struct kmem_cache *);
 int kern_ptr_validate(const void *ptr, unsigned long size);
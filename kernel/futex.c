@@ -59,6 +59,9 @@
 #include <linux/magic.h>
 #include <linux/pid.h>
 #include <linux/nsproxy.h>
+#include <linux/bootmem.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
 
 #include <asm/futex.h>
 
@@ -66,7 +69,8 @@
 
 int __read_mostly futex_cmpxchg_enabled;
 
-#define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
+/* Upper bound on the buckets of a process private hash, see below */
+#define FUTEX_PRIVATE_HASH_MAX	(1UL << 16)
 
 /*
  * Priority Inheritance state:
@@ -127,23 +131,122 @@ struct futex_q {
  * Hash buckets are shared by all the futex_keys that hash to the same
  * location.  Each key may have multiple futex_q structures, one for each task
  * waiting on a futex.
+ *
+ * Each bucket gets a cache line of its own, so that CPUs hammering on the
+ * locks of neighbouring buckets do not bounce the same line around.
  */
 struct futex_hash_bucket {
 	spinlock_t lock;
 	struct plist_head chain;
-};
+} ____cacheline_aligned_in_smp;
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+/*
+ * The global hash table is sized at boot, 256 buckets per possible CPU,
+ * so that the chance of two busy futexes sharing a bucket does not go up
+ * with the number of CPUs hitting the table.
+ */
+static struct futex_hash_bucket *futex_queues __read_mostly;
+static unsigned long futex_hashsize __read_mostly;
 
 /*
  * We hash on the keys returned from get_futex_key (see below).
+ *
+ * PROCESS_PRIVATE futexes of a process that asked for a hash of its own
+ * with PR_SET_FUTEX_HASH go to that one instead of the global table, so
+ * that they do not contend with the futexes of other processes.
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+
+	if (!(key->both.offset & (FUT_OFF_INODE|FUT_OFF_MMSHARED))) {
+		struct mm_struct *mm = key->private.mm;
+
+		if (mm && mm->futex_queues)
+			return &mm->futex_queues[hash &
+						 (mm->futex_hashsize - 1)];
+	}
+	return &futex_queues[hash & (futex_hashsize - 1)];
+}
+
+static void futex_hash_init(struct futex_hash_bucket *queues,
+			    unsigned long size)
+{
+	unsigned long i;
+
+	for (i = 0; i < size; i++) {
+		plist_head_init(&queues[i].chain, &queues[i].lock);
+		spin_lock_init(&queues[i].lock);
+	}
+}
+
+/**
+ * futex_hash_allocate() - Give the current process a private futex hash
+ * @slots:	number of hash buckets, 0 to size it to the machine
+ *
+ * The table can only be set up while the process is single threaded:
+ * once there are other users of the mm, waiters may already be queued
+ * on the global table, where they would not be found any more.
+ *
+ * Returns 0 on success, -EBUSY if the mm has other users or a table
+ * already, -EINVAL or -ENOMEM otherwise.
+ */
+int futex_hash_allocate(unsigned long slots)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_hash_bucket *queues;
+	size_t size;
+
+	if (!mm)
+		return -EINVAL;
+	if (!slots)
+		slots = max(16UL, roundup_pow_of_two(4 * num_online_cpus()));
+	if (slots > FUTEX_PRIVATE_HASH_MAX)
+		return -EINVAL;
+	slots = roundup_pow_of_two(slots);
+
+	if (atomic_read(&mm->mm_users) != 1 || mm->futex_queues)
+		return -EBUSY;
+
+	size = slots * sizeof(*queues);
+	if (size <= PAGE_SIZE)
+		queues = kmalloc(size, GFP_KERNEL);
+	else
+		queues = vmalloc(size);
+	if (!queues)
+		return -ENOMEM;
+	futex_hash_init(queues, slots);
+
+	mm->futex_hashsize = slots;
+	mm->futex_queues = queues;
+	return 0;
+}
+
+/* Number of buckets of the private futex hash, 0 if there is none */
+int futex_hash_slots(void)
+{
+	struct mm_struct *mm = current->mm;
+
+	if (!mm || !mm->futex_queues)
+		return 0;
+	return mm->futex_hashsize;
+}
+
+/* Called when the last user of the mm is gone */
+void futex_hash_free(struct mm_struct *mm)
+{
+	struct futex_hash_bucket *queues = mm->futex_queues;
+
+	if (!queues)
+		return;
+	mm->futex_queues = NULL;
+	mm->futex_hashsize = 0;
+	if (is_vmalloc_addr(queues))
+		vfree(queues);
+	else
+		kfree(queues);
 }
 
 /*
@@ -2646,8 +2749,8 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 static int __init futex_init(void)
 {
+	unsigned int futex_shift;
 	u32 curval;
-	int i;
 
 	/*
 	 * This will fail and we want it. Some arch implementations do
@@ -2663,10 +2766,17 @@ static int __init futex_init(void)
 	if (curval == -EFAULT)
 		futex_cmpxchg_enabled = 1;
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
-		plist_head_init(&futex_queues[i].chain, &futex_queues[i].lock);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+#if CONFIG_BASE_SMALL
+	futex_hashsize = 16;
+#else
+	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+#endif
+	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
+					       futex_hashsize, 0, 0,
+					       &futex_shift, NULL,
+					       futex_hashsize);
+	futex_hashsize = 1UL << futex_shift;
+	futex_hash_init(futex_queues, futex_hashsize);
 
 	return 0;
 }
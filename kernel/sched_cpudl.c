@@ -0,0 +1,249 @@
+/*
+ *  kernel/sched_cpudl.c
+ *
+ *  Global CPU deadline management
+ *
+ *  This code tracks the deadline of the earliest SCHED_DEADLINE task
+ *  queued on each CPU of a root domain, so that push and pull decisions
+ *  for deadline tasks are easy to calculate, the way sched_cpupri.c does
+ *  it for RT priorities.
+ *
+ *  The CPUs running deadline tasks are kept in a max-heap ordered by
+ *  that deadline: the root is the CPU whose earliest deadline is the
+ *  latest in the domain, i.e. the best one to preempt. CPUs with no
+ *  deadline task at all are kept in a separate mask and are preferred
+ *  over any CPU in the heap. Lookups are O(1), updates O(log(nr_cpus)).
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; version 2
+ *  of the License.
+ */
+
+#include <linux/gfp.h>
+#include <linux/kernel.h>
+#include "sched_cpudl.h"
+
+static inline int parent(int i)
+{
+	return (i - 1) >> 1;
+}
+
+static inline int left_child(int i)
+{
+	return (i << 1) + 1;
+}
+
+static inline int right_child(int i)
+{
+	return (i << 1) + 2;
+}
+
+static void cpudl_exchange(struct cpudl *cp, int a, int b)
+{
+	int cpu_a = cp->elements[a].cpu, cpu_b = cp->elements[b].cpu;
+
+	swap(cp->elements[a], cp->elements[b]);
+	swap(cp->cpu_to_idx[cpu_a], cp->cpu_to_idx[cpu_b]);
+}
+
+/* Push the element at @idx down until both its children are earlier */
+static void cpudl_heapify_down(struct cpudl *cp, int idx)
+{
+	int l, r, largest;
+
+	while (1) {
+		l = left_child(idx);
+		r = right_child(idx);
+		largest = idx;
+
+		if (l < cp->size && dl_time_before(cp->elements[idx].dl,
+						   cp->elements[l].dl))
+			largest = l;
+		if (r < cp->size && dl_time_before(cp->elements[largest].dl,
+						   cp->elements[r].dl))
+			largest = r;
+		if (largest == idx)
+			break;
+
+		cpudl_exchange(cp, largest, idx);
+		idx = largest;
+	}
+}
+
+/* Pull the element at @idx up until its parent is later */
+static void cpudl_heapify_up(struct cpudl *cp, int idx)
+{
+	while (idx > 0 && dl_time_before(cp->elements[parent(idx)].dl,
+					 cp->elements[idx].dl)) {
+		cpudl_exchange(cp, idx, parent(idx));
+		idx = parent(idx);
+	}
+}
+
+static void cpudl_change_key(struct cpudl *cp, int idx, u64 new_dl)
+{
+	WARN_ON(idx < 0 || idx >= cp->size);
+
+	if (dl_time_before(new_dl, cp->elements[idx].dl)) {
+		cp->elements[idx].dl = new_dl;
+		cpudl_heapify_down(cp, idx);
+	} else {
+		cp->elements[idx].dl = new_dl;
+		cpudl_heapify_up(cp, idx);
+	}
+}
+
+static inline int cpudl_maximum(struct cpudl *cp)
+{
+	return cp->elements[0].cpu;
+}
+
+/**
+ * cpudl_find - find the best (later-dl) CPU in the system
+ * @cp: the cpudl max-heap context
+ * @p: the task
+ * @later_mask: a mask to fill in with the selected CPUs (or NULL)
+ *
+ * Like cpupri_find(), the answer may be stale by the time the caller
+ * acts on it; the push and pull code rechecks under the rq locks.
+ *
+ * Returns: int - best CPU (heap maximum if suitable), -1 if none
+ */
+int cpudl_find(struct cpudl *cp, struct task_struct *p,
+	       struct cpumask *later_mask)
+{
+	int best_cpu = -1;
+	const struct sched_dl_entity *dl_se = &p->dl;
+
+	if (later_mask &&
+	    cpumask_and(later_mask, cp->free_cpus, &p->cpus_allowed) &&
+	    cpumask_and(later_mask, later_mask, cpu_active_mask)) {
+		best_cpu = cpumask_any(later_mask);
+		goto out;
+	} else if (cp->size > 0 &&
+		   cpumask_test_cpu(cpudl_maximum(cp), &p->cpus_allowed) &&
+		   dl_time_before(dl_se->deadline, cp->elements[0].dl)) {
+		best_cpu = cpudl_maximum(cp);
+		if (later_mask)
+			cpumask_set_cpu(best_cpu, later_mask);
+	}
+
+out:
+	WARN_ON(best_cpu != -1 && !cpu_present(best_cpu));
+
+	return best_cpu;
+}
+
+/**
+ * cpudl_set - update the cpudl max-heap
+ * @cp: the cpudl max-heap context
+ * @cpu: the target cpu
+ * @dl: the new earliest deadline for this cpu
+ * @is_valid: a flag to tell us whether the cpu has any deadline task
+ *
+ * With @is_valid set the cpu is inserted in (or moved within) the heap
+ * and taken out of the free mask; otherwise it is removed from the heap
+ * and marked free.
+ *
+ * Note: Assumes cpu_rq(cpu)->lock is locked
+ *
+ * Returns: (void)
+ */
+void cpudl_set(struct cpudl *cp, int cpu, u64 dl, int is_valid)
+{
+	int old_idx, new_cpu;
+	unsigned long flags;
+
+	WARN_ON(!cpu_present(cpu));
+
+	raw_spin_lock_irqsave(&cp->lock, flags);
+	old_idx = cp->cpu_to_idx[cpu];
+	if (!is_valid) {
+		/* remove item */
+		if (old_idx == IDX_INVALID) {
+			/*
+			 * Nothing to remove if old_idx was invalid.
+			 * This could happen if a rq_offline_dl is
+			 * called for a CPU without -dl tasks running.
+			 */
+			goto out;
+		}
+		cp->size--;
+		cp->cpu_to_idx[cpu] = IDX_INVALID;
+		if (old_idx != cp->size) {
+			new_cpu = cp->elements[cp->size].cpu;
+			cp->elements[old_idx] = cp->elements[cp->size];
+			cp->cpu_to_idx[new_cpu] = old_idx;
+			cpudl_heapify_up(cp, old_idx);
+			cpudl_heapify_down(cp, cp->cpu_to_idx[new_cpu]);
+		}
+		cpumask_set_cpu(cpu, cp->free_cpus);
+		goto out;
+	}
+
+	if (old_idx == IDX_INVALID) {
+		int new_idx = cp->size++;
+
+		cp->elements[new_idx].dl = dl;
+		cp->elements[new_idx].cpu = cpu;
+		cp->cpu_to_idx[cpu] = new_idx;
+		cpudl_heapify_up(cp, new_idx);
+		cpumask_clear_cpu(cpu, cp->free_cpus);
+	} else {
+		cpudl_change_key(cp, old_idx, dl);
+	}
+
+out:
+	raw_spin_unlock_irqrestore(&cp->lock, flags);
+}
+
+/**
+ * cpudl_set_freecpu - Set the cpudl.free_cpus
+ * @cp: the cpudl max-heap context
+ * @cpu: rd attached cpu
+ */
+void cpudl_set_freecpu(struct cpudl *cp, int cpu)
+{
+	cpumask_set_cpu(cpu, cp->free_cpus);
+}
+
+/**
+ * cpudl_clear_freecpu - Clear the cpudl.free_cpus
+ * @cp: the cpudl max-heap context
+ * @cpu: rd attached cpu
+ */
+void cpudl_clear_freecpu(struct cpudl *cp, int cpu)
+{
+	cpumask_clear_cpu(cpu, cp->free_cpus);
+}
+
+/**
+ * cpudl_init - initialize the cpudl structure
+ * @cp: the cpudl max-heap context
+ *
+ * Returns: -ENOMEM if memory fails.
+ */
+int cpudl_init(struct cpudl *cp)
+{
+	int i;
+
+	memset(cp, 0, sizeof(*cp));
+	raw_spin_lock_init(&cp->lock);
+	cp->size = 0;
+	for (i = 0; i < NR_CPUS; i++)
+		cp->cpu_to_idx[i] = IDX_INVALID;
+	if (!zalloc_cpumask_var(&cp->free_cpus, GFP_KERNEL))
+		return -ENOMEM;
+
+	return 0;
+}
+
+/**
+ * cpudl_cleanup - clean up the cpudl structure
+ * @cp: the cpudl max-heap context
+ */
+void cpudl_cleanup(struct cpudl *cp)
+{
+	free_cpumask_var(cp->free_cpus);
+}
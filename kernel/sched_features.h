@@ -62,6 +62,14 @@ SCHED_FEAT(ASYM_EFF_LOAD, 1)
  */
 SCHED_FEAT(OWNER_SPIN, 1)
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Let the load balancer move tasks to the node most of their NUMA
+ * hinting faults are on, and resist moving them off it.
+ */
+SCHED_FEAT(NUMA_LOCALITY, 1)
+#endif
+
 /*
  * Decrement CPU power based on irq activity
  */
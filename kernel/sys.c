@@ -11,6 +11,7 @@
 #include <linux/notifier.h>
 #include <linux/reboot.h>
 #include <linux/prctl.h>
+#include <linux/futex.h>
 #include <linux/highuid.h>
 #include <linux/fs.h>
 #include <linux/perf_event.h>
@@ -1080,8 +1081,10 @@ SYSCALL_DEFINE0(setsid)
 	err = session;
 out:
 	write_unlock_irq(&tasklist_lock);
-	if (err > 0)
+	if (err > 0) {
 		proc_sid_connector(group_leader);
+		sched_autogroup_create_attach(group_leader);
+	}
 	return err;
 }
 
@@ -1727,6 +1730,16 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 			else
 				error = PR_MCE_KILL_DEFAULT;
 			break;
+		case PR_SET_FUTEX_HASH:
+			if (arg3 | arg4 | arg5)
+				return -EINVAL;
+			error = futex_hash_allocate(arg2);
+			break;
+		case PR_GET_FUTEX_HASH:
+			if (arg2 | arg3 | arg4 | arg5)
+				return -EINVAL;
+			error = futex_hash_slots();
+			break;
 		default:
 			error = -EINVAL;
 			break;
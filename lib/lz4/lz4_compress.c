@@ -0,0 +1,155 @@
+/*
+ *  LZ4 Compressor
+ *
+ *  Greedy single-probe hash chain compressor for the LZ4 block format,
+ *  see lz4defs.h.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/bitops.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline u32 lz4_hash(u32 sequence)
+{
+	return (sequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static inline unsigned char *lz4_put_length(unsigned char *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+/*
+ * Returns the number of bytes that are equal at ip and ref, not looking
+ * at or past limit.
+ */
+static inline size_t lz4_count(const unsigned char *ip,
+			       const unsigned char *ref,
+			       const unsigned char *limit)
+{
+	const unsigned char *start = ip;
+
+	while (ip < limit - (sizeof(unsigned long) - 1)) {
+		unsigned long diff = get_unaligned((const unsigned long *)ref) ^
+				     get_unaligned((const unsigned long *)ip);
+
+		if (!diff) {
+			ip += sizeof(unsigned long);
+			ref += sizeof(unsigned long);
+			continue;
+		}
+#ifdef __LITTLE_ENDIAN
+		ip += __ffs(diff) >> 3;
+#else
+		ip += (BITS_PER_LONG - 1 - __fls(diff)) >> 3;
+#endif
+		return ip - start;
+	}
+
+	while (ip < limit && *ip == *ref) {
+		ip++;
+		ref++;
+	}
+	return ip - start;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	u32 *table = wrkmem;
+	const unsigned char *ip = src;
+	const unsigned char *anchor = src;
+	const unsigned char * const iend = src + src_len;
+	const unsigned char * const mflimit = iend - MFLIMIT;
+	const unsigned char * const matchlimit = iend - LASTLITERALS;
+	unsigned char *op = dst;
+	unsigned char *token;
+	size_t lit_len, match_len;
+
+	if (src_len < MFLIMIT + 1)
+		goto last_literals;
+
+	memset(table, 0, LZ4_MEM_COMPRESS);
+	table[lz4_hash(get_unaligned((const u32 *)ip))] = 0;
+	ip++;
+
+	while (ip < mflimit) {
+		const unsigned char *ref;
+		unsigned int attempts = 1 << SKIPSTRENGTH;
+		u32 h;
+
+		/* find a match */
+		for (;;) {
+			u32 seq = get_unaligned((const u32 *)ip);
+
+			h = lz4_hash(seq);
+			ref = src + table[h];
+			table[h] = ip - src;
+			if (ref < ip && ip - ref <= MAX_DISTANCE &&
+			    get_unaligned((const u32 *)ref) == seq)
+				break;
+			ip += attempts++ >> SKIPSTRENGTH;
+			if (unlikely(ip >= mflimit))
+				goto last_literals;
+		}
+
+		/* catch up with equal bytes before the match */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		/* literals */
+		lit_len = ip - anchor;
+		token = op++;
+		if (lit_len >= RUN_MASK) {
+			*token = RUN_MASK << ML_BITS;
+			op = lz4_put_length(op, lit_len - RUN_MASK);
+		} else
+			*token = lit_len << ML_BITS;
+		memcpy(op, anchor, lit_len);
+		op += lit_len;
+
+		/* match */
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+		match_len = lz4_count(ip + MINMATCH, ref + MINMATCH,
+				      matchlimit);
+		ip += MINMATCH + match_len;
+		if (match_len >= ML_MASK) {
+			*token |= ML_MASK;
+			op = lz4_put_length(op, match_len - ML_MASK);
+		} else
+			*token |= match_len;
+
+		anchor = ip;
+		if (ip < mflimit)
+			table[lz4_hash(get_unaligned((const u32 *)(ip - 2)))] =
+				ip - 2 - src;
+	}
+
+last_literals:
+	lit_len = iend - anchor;
+	token = op++;
+	if (lit_len >= RUN_MASK) {
+		*token = RUN_MASK << ML_BITS;
+		op = lz4_put_length(op, lit_len - RUN_MASK);
+	} else
+		*token = lit_len << ML_BITS;
+	memcpy(op, anchor, lit_len);
+	op += lit_len;
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
@@ -0,0 +1,101 @@
+/*
+ *  LZ4 Decompressor
+ *
+ *  Decodes the LZ4 block format, see lz4defs.h, checking every length
+ *  and offset against both buffers.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/*
+ * Reads the extension bytes of a length whose nibble was 15. Returns
+ * false if the input ends first.
+ */
+static inline bool lz4_get_length(const unsigned char **ipp,
+				  const unsigned char *iend, size_t *len)
+{
+	const unsigned char *ip = *ipp;
+	unsigned int s;
+
+	do {
+		if (unlikely(ip >= iend))
+			return false;
+		s = *ip++;
+		*len += s;
+	} while (s == 255);
+
+	*ipp = ip;
+	return true;
+}
+
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len)
+{
+	const unsigned char *ip = src;
+	const unsigned char * const iend = src + src_len;
+	unsigned char *op = dst;
+	unsigned char * const oend = dst + *dst_len;
+
+	for (;;) {
+		const unsigned char *ref;
+		unsigned int token;
+		size_t len, offset;
+
+		if (unlikely(ip >= iend))
+			return LZ4_E_INPUT_OVERRUN;
+		token = *ip++;
+
+		/* literals */
+		len = token >> ML_BITS;
+		if (len == RUN_MASK && !lz4_get_length(&ip, iend, &len))
+			return LZ4_E_INPUT_OVERRUN;
+		if (unlikely(len > iend - ip))
+			return LZ4_E_INPUT_OVERRUN;
+		if (unlikely(len > oend - op))
+			return LZ4_E_OUTPUT_OVERRUN;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* the last sequence has no match */
+		if (ip == iend)
+			break;
+
+		/* match */
+		if (unlikely(iend - ip < 2))
+			return LZ4_E_INPUT_OVERRUN;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(!offset || offset > op - dst))
+			return LZ4_E_LOOKBEHIND_OVERRUN;
+		ref = op - offset;
+
+		len = token & ML_MASK;
+		if (len == ML_MASK && !lz4_get_length(&ip, iend, &len))
+			return LZ4_E_INPUT_OVERRUN;
+		len += MINMATCH;
+		if (unlikely(len > oend - op))
+			return LZ4_E_OUTPUT_OVERRUN;
+
+		if (offset >= len) {
+			memcpy(op, ref, len);
+			op += len;
+		} else {
+			/* overlapping match, replicates the last bytes */
+			while (len--)
+				*op++ = *ref++;
+		}
+	}
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_decompress_safe);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
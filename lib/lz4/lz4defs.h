@@ -0,0 +1,26 @@
+/*
+ *  lz4defs.h -- common definitions of the LZ4 block format
+ *
+ *  A sequence is a token byte, whose high nibble is the literal length
+ *  and whose low nibble is the match length minus MINMATCH, optional
+ *  literal length extension bytes, the literals, a 16-bit little endian
+ *  match offset and optional match length extension bytes. A nibble of
+ *  15 is extended by bytes that are summed until one is not 255. The
+ *  last sequence carries only literals.
+ */
+
+#define MINMATCH	4
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+#define MAX_DISTANCE	65535
+
+/* the last match must start at least MFLIMIT bytes before the end */
+#define MFLIMIT		12
+/* and the last LASTLITERALS bytes are always literals */
+#define LASTLITERALS	5
+
+/* give up on incompressible data faster: grow the step every 2^SKIP */
+#define SKIPSTRENGTH	6
@@ -211,6 +211,11 @@ SYSCALL_DEFINE5(remap_file_pages, unsigned long, start, unsigned long, size,
 			}
 			goto out;
 		}
+		if (vma->vm_flags & VM_HUGEPAGE) {
+			/* nonlinear ptes cannot live under huge pmds */
+			vma->vm_flags &= ~VM_HUGEPAGE;
+			split_huge_file_pmds(vma);
+		}
 		spin_lock(&mapping->i_mmap_lock);
 		flush_dcache_mmap_lock(mapping);
 		vma->vm_flags |= VM_NONLINEAR;
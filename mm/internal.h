@@ -54,6 +54,27 @@ extern void prep_compound_page(struct page *page, unsigned long order);
 extern bool is_free_buddy_page(struct page *page);
 #endif
 
+/*
+ * in mm/lru_gen.c
+ */
+#ifdef CONFIG_LRU_GEN
+extern void lru_gen_init_zone(struct zone *zone);
+extern void lru_gen_update_min_seq(struct zone *zone, int file);
+extern int lru_gen_need_aging(struct zone *zone, int file);
+extern void lru_gen_age(void);
+#else
+static inline void lru_gen_init_zone(struct zone *zone)
+{
+}
+static inline int lru_gen_need_aging(struct zone *zone, int file)
+{
+	return 0;
+}
+static inline void lru_gen_age(void)
+{
+}
+#endif
+
 
 /*
  * function for dealing with page's order in buddy system.
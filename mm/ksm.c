@@ -76,6 +76,15 @@
  *    take 10 attempts to find a page in the unstable tree, once it is found,
  *    it is secured in the stable tree.  (When we scan a new page, we first
  *    compare it against the stable tree, and then against the unstable tree.)
+ *
+ * There is a stable and an unstable tree per NUMA node, each pair under its
+ * own mutex, and a page is only ever compared with and merged into those of
+ * the node it is on (unless merge_across_nodes is set, when node 0's trees
+ * are used for all).  Several ksmd threads scan at the same time: each takes
+ * the next mm_slot of the full scan in turn, so following page tables and
+ * checksumming run in parallel, as do tree operations on different nodes.
+ * A full scan ends, and the unstable trees are flushed, only once every
+ * mm_slot has been handed out and all the threads are done with theirs.
  */
 
 /**
@@ -94,18 +103,17 @@ struct mm_slot {
 
 /**
  * struct ksm_scan - cursor for scanning
- * @mm_slot: the current mm_slot we are scanning
+ * @mm_slot: the current mm_slot we are scanning, NULL if none
  * @address: the next address inside that to be scanned
  * @rmap_list: link to the next rmap to be scanned in the rmap_list
- * @seqnr: count of completed full scans (needed when removing unstable node)
  *
- * There is only the one ksm_scan instance of this cursor structure.
+ * Each ksmd thread has its own cursor; the cursor of a thread that was
+ * stopped in the middle of an mm_slot is taken over by another thread.
  */
 struct ksm_scan {
 	struct mm_slot *mm_slot;
 	unsigned long address;
 	struct rmap_item **rmap_list;
-	unsigned long seqnr;
 };
 
 /**
@@ -113,11 +121,31 @@ struct ksm_scan {
  * @node: rb node of this ksm page in the stable tree
  * @hlist: hlist head of rmap_items using this ksm page
  * @kpfn: page frame number of this ksm page
+ * @nid: NUMA node of the stable tree this node is in
  */
 struct stable_node {
 	struct rb_node node;
 	struct hlist_head hlist;
 	unsigned long kpfn;
+	int nid;
+};
+
+/**
+ * struct ksm_tree - the stable and unstable tree of one NUMA node
+ * @lock: serializes searches and updates of both trees
+ * @stable: root of the stable tree
+ * @unstable: root of the unstable tree
+ * @pages_shared: number of nodes in the stable tree
+ * @pages_sharing: number of page slots additionally sharing those nodes
+ * @pages_unshared: number of nodes in the unstable tree
+ */
+struct ksm_tree {
+	struct mutex lock;
+	struct rb_root stable;
+	struct rb_root unstable;
+	unsigned long pages_shared;
+	unsigned long pages_sharing;
+	unsigned long pages_unshared;
 };
 
 /**
@@ -127,6 +155,7 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
+ * @nid: NUMA node of the tree this rmap_item is in, when in a tree
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -137,6 +166,7 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+	int nid;			/* when in a tree */
 	union {
 		struct rb_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
@@ -150,9 +180,8 @@ struct rmap_item {
 #define UNSTABLE_FLAG	0x100	/* is a node of the unstable tree */
 #define STABLE_FLAG	0x200	/* is listed from the stable tree */
 
-/* The stable and unstable tree heads */
-static struct rb_root root_stable_tree = RB_ROOT;
-static struct rb_root root_unstable_tree = RB_ROOT;
+/* The stable and unstable trees, nr_node_ids of them */
+static struct ksm_tree *ksm_trees;
 
 #define MM_SLOTS_HASH_SHIFT 10
 #define MM_SLOTS_HASH_HEADS (1 << MM_SLOTS_HASH_SHIFT)
@@ -161,25 +190,65 @@ static struct hlist_head mm_slots_hash[MM_SLOTS_HASH_HEADS];
 static struct mm_slot ksm_mm_head = {
 	.mm_list = LIST_HEAD_INIT(ksm_mm_head.mm_list),
 };
-static struct ksm_scan ksm_scan = {
-	.mm_slot = &ksm_mm_head,
-};
 
-static struct kmem_cache *rmap_item_cache;
-static struct kmem_cache *stable_node_cache;
-static struct kmem_cache *mm_slot_cache;
+#define KSM_MAX_THREADS	32
 
-/* The number of nodes in the stable tree */
-static unsigned long ksm_pages_shared;
+/* The ksmd threads and their cursors */
+static struct task_struct *ksm_threads[KSM_MAX_THREADS];
+static struct ksm_scan ksm_scans[KSM_MAX_THREADS];
+static unsigned int ksm_nr_threads;
 
-/* The number of page slots additionally sharing those nodes */
-static unsigned long ksm_pages_sharing;
+/*
+ * The next mm_slot to hand out in this full scan, &ksm_mm_head once all
+ * have been; and the number of cursors still busy with one.
+ */
+static struct mm_slot *ksm_next_slot = &ksm_mm_head;
+static unsigned int ksm_scans_busy;
+static bool ksm_scan_running;
 
-/* The number of nodes in the unstable tree */
-static unsigned long ksm_pages_unshared;
+/* Count of completed full scans (needed when removing unstable node) */
+static unsigned long ksm_seqnr;
+
+static struct kmem_cache *rmap_item_cache;
+static struct kmem_cache *stable_node_cache;
+static struct kmem_cache *mm_slot_cache;
 
 /* The number of rmap_items in use: to calculate pages_volatile */
-static unsigned long ksm_rmap_items;
+static atomic_long_t ksm_rmap_items = ATOMIC_LONG_INIT(0);
+
+/* Sum of a ksm_tree counter over all nodes */
+#define ksm_tree_sum(_field)						\
+({									\
+	unsigned long __sum = 0;					\
+	int __nid;							\
+	for (__nid = 0; __nid < nr_node_ids; __nid++)			\
+		__sum += ksm_trees[__nid]._field;			\
+	__sum;								\
+})
+#define ksm_pages_shared	ksm_tree_sum(pages_shared)
+#define ksm_pages_sharing	ksm_tree_sum(pages_sharing)
+#define ksm_pages_unshared	ksm_tree_sum(pages_unshared)
+
+/* Keep the pages of different NUMA nodes in different trees */
+static unsigned int ksm_merge_across_nodes;
+
+/*
+ * Cost and progress of the scanning, under ksm_mmlist_lock: start time of
+ * the current full scan, duration and cpu time of the last one, and when
+ * merging (re)started and how long it took to converge. Merging is taken
+ * to have converged after two consecutive full scans that merged nothing.
+ */
+static unsigned long ksm_scan_start;
+static unsigned int ksm_last_scan_msecs;
+static u64 ksm_scan_cpu_start;
+static u64 ksm_last_scan_cpu_ns;
+static unsigned long ksm_converge_start;
+static unsigned int ksm_converge_msecs;
+static unsigned int ksm_idle_scans;
+
+/* Cpu time used by all ksmd threads, and pages merged in this full scan */
+static atomic64_t ksm_cpu_ns = ATOMIC64_INIT(0);
+static atomic_long_t ksm_scan_merged = ATOMIC_LONG_INIT(0);
 
 /* Number of pages ksmd should scan in one batch */
 static unsigned int ksm_thread_pages_to_scan = 100;
@@ -193,7 +262,10 @@ static unsigned int ksm_thread_sleep_millisecs = 20;
 static unsigned int ksm_run = KSM_RUN_STOP;
 
 static DECLARE_WAIT_QUEUE_HEAD(ksm_thread_wait);
-static DEFINE_MUTEX(ksm_thread_mutex);
+/* Held for read by ksmd threads while scanning, for write to stop them */
+static DECLARE_RWSEM(ksm_thread_sem);
+/* Serializes starting and stopping ksmd threads */
+static DEFINE_MUTEX(ksm_threads_mutex);
 static DEFINE_SPINLOCK(ksm_mmlist_lock);
 
 #define KSM_KMEM_CACHE(__struct, __flags) kmem_cache_create("ksm_"#__struct,\
@@ -238,13 +310,13 @@ static inline struct rmap_item *alloc_rmap_item(void)
 
 	rmap_item = kmem_cache_zalloc(rmap_item_cache, GFP_KERNEL);
 	if (rmap_item)
-		ksm_rmap_items++;
+		atomic_long_inc(&ksm_rmap_items);
 	return rmap_item;
 }
 
 static inline void free_rmap_item(struct rmap_item *rmap_item)
 {
-	ksm_rmap_items--;
+	atomic_long_dec(&ksm_rmap_items);
 	rmap_item->mm = NULL;	/* debug safety */
 	kmem_cache_free(rmap_item_cache, rmap_item);
 }
@@ -300,6 +372,26 @@ static inline int in_stable_tree(struct rmap_item *rmap_item)
 	return rmap_item->address & STABLE_FLAG;
 }
 
+/* The node whose trees a page at @kpfn belongs in */
+static inline int get_kpfn_nid(unsigned long kpfn)
+{
+	return ksm_merge_across_nodes ? 0 : pfn_to_nid(kpfn);
+}
+
+/*
+ * Is an mm_slot being scanned, so that it must be left for its cursor to
+ * free? Called under ksm_mmlist_lock.
+ */
+static bool ksm_slot_busy(struct mm_slot *mm_slot)
+{
+	int i;
+
+	for (i = 0; i < KSM_MAX_THREADS; i++)
+		if (ksm_scans[i].mm_slot == mm_slot)
+			return true;
+	return false;
+}
+
 static void hold_anon_vma(struct rmap_item *rmap_item,
 			  struct anon_vma *anon_vma)
 {
@@ -441,22 +533,27 @@ out:		page = NULL;
 	return page;
 }
 
+/*
+ * The caller holds the lock of the node's tree, or has all ksmd threads
+ * locked out.
+ */
 static void remove_node_from_stable_tree(struct stable_node *stable_node)
 {
+	struct ksm_tree *tree = &ksm_trees[stable_node->nid];
 	struct rmap_item *rmap_item;
 	struct hlist_node *hlist;
 
 	hlist_for_each_entry(rmap_item, hlist, &stable_node->hlist, hlist) {
 		if (rmap_item->hlist.next)
-			ksm_pages_sharing--;
+			tree->pages_sharing--;
 		else
-			ksm_pages_shared--;
+			tree->pages_shared--;
 		ksm_drop_anon_vma(rmap_item);
 		rmap_item->address &= PAGE_MASK;
 		cond_resched();
 	}
 
-	rb_erase(&stable_node->node, &root_stable_tree);
+	rb_erase(&stable_node->node, &tree->stable);
 	free_stable_node(stable_node);
 }
 
@@ -478,7 +575,7 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
  * a page to put something that might look like our key in page->mapping.
  *
  * include/linux/pagemap.h page_cache_get_speculative() is a good reference,
- * but this is different - made simpler by ksm_thread_mutex being held, but
+ * but this is different - made simpler by the tree lock being held, but
  * interesting for assuming that no other use of the struct page could ever
  * put our expected_mapping into page->mapping (or a field of the union which
  * coincides with page->mapping).  The RCU calls are not for KSM at all, but
@@ -517,9 +614,12 @@ stale:
 /*
  * Removing rmap_item from stable or unstable tree.
  * This function will clean the information from the stable/unstable tree.
+ * The caller holds the lock of the tree the rmap_item is in.
  */
-static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
+static void __remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 {
+	struct ksm_tree *tree = &ksm_trees[rmap_item->nid];
+
 	if (rmap_item->address & STABLE_FLAG) {
 		struct stable_node *stable_node;
 		struct page *page;
@@ -527,7 +627,7 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		stable_node = rmap_item->head;
 		page = get_ksm_page(stable_node);
 		if (!page)
-			goto out;
+			return;
 
 		lock_page(page);
 		hlist_del(&rmap_item->hlist);
@@ -535,9 +635,9 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		put_page(page);
 
 		if (stable_node->hlist.first)
-			ksm_pages_sharing--;
+			tree->pages_sharing--;
 		else
-			ksm_pages_shared--;
+			tree->pages_shared--;
 
 		ksm_drop_anon_vma(rmap_item);
 		rmap_item->address &= PAGE_MASK;
@@ -546,29 +646,65 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		unsigned char age;
 		/*
 		 * Usually ksmd can and must skip the rb_erase, because
-		 * root_unstable_tree was already reset to RB_ROOT.
+		 * the unstable tree was already reset to RB_ROOT.
 		 * But be careful when an mm is exiting: do the rb_erase
 		 * if this rmap_item was inserted by this scan, rather
 		 * than left over from before.
 		 */
-		age = (unsigned char)(ksm_scan.seqnr - rmap_item->address);
+		age = (unsigned char)(ksm_seqnr - rmap_item->address);
 		BUG_ON(age > 1);
 		if (!age)
-			rb_erase(&rmap_item->node, &root_unstable_tree);
+			rb_erase(&rmap_item->node, &tree->unstable);
 
-		ksm_pages_unshared--;
+		tree->pages_unshared--;
 		rmap_item->address &= PAGE_MASK;
 	}
-out:
+}
+
+/*
+ * Only the cursor scanning an rmap_item's mm_slot puts it into a tree,
+ * so if it is in none now it stays that way; if it is in one, other
+ * threads only ever move it within the trees of the same node, under
+ * that node's lock.
+ *
+ * The tree lock is held while cmp_and_merge_page() takes the mmap_sem
+ * of other mms, so it must never be taken with an mmap_sem held: see
+ * defer_rmap_items().
+ */
+static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
+{
+	if (rmap_item->address & (STABLE_FLAG | UNSTABLE_FLAG)) {
+		struct ksm_tree *tree = &ksm_trees[rmap_item->nid];
+
+		mutex_lock(&tree->lock);
+		__remove_rmap_item_from_tree(rmap_item);
+		mutex_unlock(&tree->lock);
+	}
 	cond_resched();		/* we're called from many long loops */
 }
 
-static void remove_trailing_rmap_items(struct mm_slot *mm_slot,
-				       struct rmap_item **rmap_list)
+/*
+ * Unlink the rmap_items from *@rmap_list onwards from their mm_slot and
+ * chain them on @stale, through rmap_list, for free_stale_rmap_items()
+ * to remove from their trees once the caller has dropped mmap_sem.
+ * Until then they stay in the trees like any other rmap_item of the mm.
+ */
+static void defer_rmap_items(struct rmap_item **rmap_list,
+			     struct rmap_item *end, struct rmap_item **stale)
 {
-	while (*rmap_list) {
+	while (*rmap_list != end) {
 		struct rmap_item *rmap_item = *rmap_list;
 		*rmap_list = rmap_item->rmap_list;
+		rmap_item->rmap_list = *stale;
+		*stale = rmap_item;
+	}
+}
+
+static void free_stale_rmap_items(struct rmap_item **stale)
+{
+	while (*stale) {
+		struct rmap_item *rmap_item = *stale;
+		*stale = rmap_item->rmap_list;
 		remove_rmap_item_from_tree(rmap_item);
 		free_rmap_item(rmap_item);
 	}
@@ -610,35 +746,48 @@ static int unmerge_ksm_pages(struct vm_area_struct *vma,
  */
 static int unmerge_and_remove_all_rmap_items(void)
 {
+	struct ksm_scan *scan = &ksm_scans[0];
 	struct mm_slot *mm_slot;
 	struct mm_struct *mm;
 	struct vm_area_struct *vma;
-	int err = 0;
+	struct rmap_item *stale = NULL;
+	int i, err = 0;
 
+	/*
+	 * The ksmd threads are locked out: abandon the full scan they were
+	 * in, all the rmap_items are about to be removed anyway.
+	 */
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(ksm_mm_head.mm_list.next,
+	for (i = 0; i < KSM_MAX_THREADS; i++)
+		ksm_scans[i].mm_slot = NULL;
+	ksm_scans_busy = 0;
+	ksm_next_slot = &ksm_mm_head;
+	scan->mm_slot = list_entry(ksm_mm_head.mm_list.next,
 						struct mm_slot, mm_list);
 	spin_unlock(&ksm_mmlist_lock);
 
-	for (mm_slot = ksm_scan.mm_slot;
-			mm_slot != &ksm_mm_head; mm_slot = ksm_scan.mm_slot) {
+	for (mm_slot = scan->mm_slot;
+			mm_slot != &ksm_mm_head; mm_slot = scan->mm_slot) {
 		mm = mm_slot->mm;
 		down_read(&mm->mmap_sem);
-		for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		for (vma = mm->mmap; vma && !err; vma = vma->vm_next) {
 			if (ksm_test_exit(mm))
 				break;
 			if (!(vma->vm_flags & VM_MERGEABLE) || !vma->anon_vma)
 				continue;
 			err = unmerge_ksm_pages(vma,
 						vma->vm_start, vma->vm_end);
-			if (err)
-				goto error;
 		}
 
-		remove_trailing_rmap_items(mm_slot, &mm_slot->rmap_list);
+		/*
+		 * Even once unmerging has failed, carry on removing the
+		 * rmap_items: none may be left in an unstable tree from
+		 * the abandoned full scan.
+		 */
+		defer_rmap_items(&mm_slot->rmap_list, NULL, &stale);
 
 		spin_lock(&ksm_mmlist_lock);
-		ksm_scan.mm_slot = list_entry(mm_slot->mm_list.next,
+		scan->mm_slot = list_entry(mm_slot->mm_list.next,
 						struct mm_slot, mm_list);
 		if (ksm_test_exit(mm)) {
 			hlist_del(&mm_slot->link);
@@ -648,21 +797,20 @@ static int unmerge_and_remove_all_rmap_items(void)
 			free_mm_slot(mm_slot);
 			clear_bit(MMF_VM_MERGEABLE, &mm->flags);
 			up_read(&mm->mmap_sem);
+			free_stale_rmap_items(&stale);
 			mmdrop(mm);
 		} else {
 			spin_unlock(&ksm_mmlist_lock);
 			up_read(&mm->mmap_sem);
+			free_stale_rmap_items(&stale);
 		}
 	}
 
-	ksm_scan.seqnr = 0;
-	return 0;
-
-error:
-	up_read(&mm->mmap_sem);
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = &ksm_mm_head;
+	scan->mm_slot = NULL;
+	ksm_scan_running = false;
 	spin_unlock(&ksm_mmlist_lock);
+	ksm_seqnr = 0;
 	return err;
 }
 #endif /* CONFIG_SYSFS */
@@ -946,9 +1094,10 @@ static struct page *try_to_merge_two_pages(struct rmap_item *rmap_item,
  * This function returns the stable tree node of identical content if found,
  * NULL otherwise.
  */
-static struct page *stable_tree_search(struct page *page)
+static struct page *stable_tree_search(struct ksm_tree *tree,
+				       struct page *page)
 {
-	struct rb_node *node = root_stable_tree.rb_node;
+	struct rb_node *node = tree->stable.rb_node;
 	struct stable_node *stable_node;
 
 	stable_node = page_stable_node(page);
@@ -975,6 +1124,16 @@ static struct page *stable_tree_search(struct page *page)
 		} else if (ret > 0) {
 			put_page(tree_page);
 			node = node->rb_right;
+		} else if (get_kpfn_nid(page_to_pfn(tree_page)) !=
+			   tree - ksm_trees) {
+			/*
+			 * The ksm page has been migrated to another node
+			 * since it was inserted: don't merge with it, but
+			 * with an identical page inserted after it, which
+			 * stable_tree_insert() put to its right.
+			 */
+			put_page(tree_page);
+			node = node->rb_right;
 		} else
 			return tree_page;
 	}
@@ -989,9 +1148,10 @@ static struct page *stable_tree_search(struct page *page)
  * This function returns the stable tree node just allocated on success,
  * NULL otherwise.
  */
-static struct stable_node *stable_tree_insert(struct page *kpage)
+static struct stable_node *stable_tree_insert(struct ksm_tree *tree,
+					      struct page *kpage)
 {
-	struct rb_node **new = &root_stable_tree.rb_node;
+	struct rb_node **new = &tree->stable.rb_node;
 	struct rb_node *parent = NULL;
 	struct stable_node *stable_node;
 
@@ -1006,6 +1166,10 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 			return NULL;
 
 		ret = memcmp_pages(kpage, tree_page);
+		/* migrated away since it was inserted: see stable_tree_search() */
+		if (!ret && get_kpfn_nid(page_to_pfn(tree_page)) !=
+			    tree - ksm_trees)
+			ret = 1;
 		put_page(tree_page);
 
 		parent = *new;
@@ -1028,11 +1192,12 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 		return NULL;
 
 	rb_link_node(&stable_node->node, parent, new);
-	rb_insert_color(&stable_node->node, &root_stable_tree);
+	rb_insert_color(&stable_node->node, &tree->stable);
 
 	INIT_HLIST_HEAD(&stable_node->hlist);
 
 	stable_node->kpfn = page_to_pfn(kpage);
+	stable_node->nid = tree - ksm_trees;
 	set_page_stable_node(kpage, stable_node);
 
 	return stable_node;
@@ -1053,12 +1218,13 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
  * the same walking algorithm in an rbtree.
  */
 static
-struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
+struct rmap_item *unstable_tree_search_insert(struct ksm_tree *tree,
+					      struct rmap_item *rmap_item,
 					      struct page *page,
 					      struct page **tree_pagep)
 
 {
-	struct rb_node **new = &root_unstable_tree.rb_node;
+	struct rb_node **new = &tree->unstable.rb_node;
 	struct rb_node *parent = NULL;
 
 	while (*new) {
@@ -1080,6 +1246,15 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 			return NULL;
 		}
 
+		/*
+		 * Nor merge with a page that has been migrated to another
+		 * node since it was inserted.
+		 */
+		if (get_kpfn_nid(page_to_pfn(tree_page)) != tree - ksm_trees) {
+			put_page(tree_page);
+			return NULL;
+		}
+
 		ret = memcmp_pages(page, tree_page);
 
 		parent = *new;
@@ -1096,11 +1271,12 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 	}
 
 	rmap_item->address |= UNSTABLE_FLAG;
-	rmap_item->address |= (ksm_scan.seqnr & SEQNR_MASK);
+	rmap_item->address |= (ksm_seqnr & SEQNR_MASK);
+	rmap_item->nid = tree - ksm_trees;
 	rb_link_node(&rmap_item->node, parent, new);
-	rb_insert_color(&rmap_item->node, &root_unstable_tree);
+	rb_insert_color(&rmap_item->node, &tree->unstable);
 
-	ksm_pages_unshared++;
+	tree->pages_unshared++;
 	return NULL;
 }
 
@@ -1112,14 +1288,18 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 static void stable_tree_append(struct rmap_item *rmap_item,
 			       struct stable_node *stable_node)
 {
+	struct ksm_tree *tree = &ksm_trees[stable_node->nid];
+
 	rmap_item->head = stable_node;
+	rmap_item->nid = stable_node->nid;
 	rmap_item->address |= STABLE_FLAG;
 	hlist_add_head(&rmap_item->hlist, &stable_node->hlist);
 
 	if (rmap_item->hlist.next)
-		ksm_pages_sharing++;
+		tree->pages_sharing++;
 	else
-		ksm_pages_shared++;
+		tree->pages_shared++;
+	atomic_long_inc(&ksm_scan_merged);
 }
 
 /*
@@ -1128,6 +1308,10 @@ static void stable_tree_append(struct rmap_item *rmap_item,
  * be inserted into the unstable tree, or merged with a page already there and
  * both transferred to the stable tree.
  *
+ * The trees searched are those of the page's node, and their lock is held
+ * throughout each search and the merges that follow it; the checksum is
+ * calculated without it.
+ *
  * @page: the page that we are searching identical page to.
  * @rmap_item: the reverse mapping into the virtual address of this page
  */
@@ -1136,14 +1320,24 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	struct rmap_item *tree_rmap_item;
 	struct page *tree_page = NULL;
 	struct stable_node *stable_node;
+	struct ksm_tree *tree;
 	struct page *kpage;
 	unsigned int checksum;
-	int err;
+	int err, nid;
 
 	remove_rmap_item_from_tree(rmap_item);
 
+	/* A forked ksm page stays with the tree its stable_node is in */
+	stable_node = page_stable_node(page);
+	if (stable_node)
+		nid = stable_node->nid;
+	else
+		nid = get_kpfn_nid(page_to_pfn(page));
+	tree = &ksm_trees[nid];
+
 	/* We first start with searching the page inside the stable tree */
-	kpage = stable_tree_search(page);
+	mutex_lock(&tree->lock);
+	kpage = stable_tree_search(tree, page);
 	if (kpage) {
 		err = try_to_merge_with_ksm_page(rmap_item, page, kpage);
 		if (!err) {
@@ -1155,9 +1349,11 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			stable_tree_append(rmap_item, page_stable_node(kpage));
 			unlock_page(kpage);
 		}
+		mutex_unlock(&tree->lock);
 		put_page(kpage);
 		return;
 	}
+	mutex_unlock(&tree->lock);
 
 	/*
 	 * If the hash value of the page has changed from the last time
@@ -1171,8 +1367,9 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 		return;
 	}
 
+	mutex_lock(&tree->lock);
 	tree_rmap_item =
-		unstable_tree_search_insert(rmap_item, page, &tree_page);
+		unstable_tree_search_insert(tree, rmap_item, page, &tree_page);
 	if (tree_rmap_item) {
 		kpage = try_to_merge_two_pages(rmap_item, page,
 						tree_rmap_item, tree_page);
@@ -1183,10 +1380,10 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 		 * tree, and insert it instead as new node in the stable tree.
 		 */
 		if (kpage) {
-			remove_rmap_item_from_tree(tree_rmap_item);
+			__remove_rmap_item_from_tree(tree_rmap_item);
 
 			lock_page(kpage);
-			stable_node = stable_tree_insert(kpage);
+			stable_node = stable_tree_insert(tree, kpage);
 			if (stable_node) {
 				stable_tree_append(tree_rmap_item, stable_node);
 				stable_tree_append(rmap_item, stable_node);
@@ -1205,11 +1402,17 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			}
 		}
 	}
+	mutex_unlock(&tree->lock);
 }
 
+/*
+ * Called with mmap_sem held: the rmap_items passed over are left on
+ * @stale for the caller to free once it has dropped it.
+ */
 static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 					    struct rmap_item **rmap_list,
-					    unsigned long addr)
+					    unsigned long addr,
+					    struct rmap_item **stale)
 {
 	struct rmap_item *rmap_item;
 
@@ -1219,9 +1422,7 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 			return rmap_item;
 		if (rmap_item->address > addr)
 			break;
-		*rmap_list = rmap_item->rmap_list;
-		remove_rmap_item_from_tree(rmap_item);
-		free_rmap_item(rmap_item);
+		defer_rmap_items(rmap_list, rmap_item->rmap_list, stale);
 	}
 
 	rmap_item = alloc_rmap_item();
@@ -1235,83 +1436,163 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
-static struct rmap_item *scan_get_next_rmap_item(struct page **page)
+/*
+ * Start timing convergence again: merging has just been started, or there
+ * is a new mm to merge. Called under ksm_mmlist_lock.
+ */
+static void ksm_restart_converge(void)
+{
+	ksm_converge_start = jiffies;
+	ksm_converge_msecs = 0;
+	ksm_idle_scans = 0;
+}
+
+/*
+ * Account the end of a full scan: every mm_slot has been handed out and
+ * no cursor is busy with one any more. Called under ksm_mmlist_lock.
+ */
+static void ksm_full_scan_done(void)
+{
+	u64 cpu_ns = atomic64_read(&ksm_cpu_ns);
+
+	ksm_seqnr++;
+	ksm_last_scan_msecs = jiffies_to_msecs(jiffies - ksm_scan_start);
+	ksm_last_scan_cpu_ns = cpu_ns - ksm_scan_cpu_start;
+
+	if (atomic_long_xchg(&ksm_scan_merged, 0))
+		ksm_idle_scans = 0;
+	else if (++ksm_idle_scans == 2 && !ksm_converge_msecs)
+		ksm_converge_msecs = max(jiffies_to_msecs(jiffies -
+					 ksm_converge_start), 1U);
+}
+
+/*
+ * Give @scan an mm_slot to work on: the one a stopped thread left half
+ * scanned, or else the next one of the full scan. Once all mm_slots have
+ * been handed out and finished, the full scan is complete: flush the
+ * unstable trees and start the next one.
+ *
+ * Returns false if there is nothing to do until the other cursors are
+ * done with their mm_slots.
+ */
+static bool ksm_scan_next_slot(struct ksm_scan *scan)
+{
+	struct mm_slot *slot;
+	int i, nid;
+
+	spin_lock(&ksm_mmlist_lock);
+	for (i = 0; i < KSM_MAX_THREADS; i++) {
+		struct ksm_scan *orphan = &ksm_scans[i];
+
+		if (!ksm_threads[i] && orphan->mm_slot) {
+			*scan = *orphan;
+			orphan->mm_slot = NULL;
+			spin_unlock(&ksm_mmlist_lock);
+			return true;
+		}
+	}
+
+	if (ksm_next_slot == &ksm_mm_head || !ksm_scan_running) {
+		if (ksm_scans_busy || list_empty(&ksm_mm_head.mm_list)) {
+			spin_unlock(&ksm_mmlist_lock);
+			return false;
+		}
+		if (ksm_scan_running)
+			ksm_full_scan_done();
+		ksm_scan_running = true;
+		ksm_scan_start = jiffies;
+		ksm_scan_cpu_start = atomic64_read(&ksm_cpu_ns);
+
+		/* No cursor is busy, so no tree is in use */
+		for (nid = 0; nid < nr_node_ids; nid++)
+			ksm_trees[nid].unstable = RB_ROOT;
+
+		ksm_next_slot = list_entry(ksm_mm_head.mm_list.next,
+					   struct mm_slot, mm_list);
+	}
+
+	slot = ksm_next_slot;
+	ksm_next_slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
+	ksm_scans_busy++;
+	scan->mm_slot = slot;
+	scan->address = 0;
+	scan->rmap_list = &slot->rmap_list;
+	spin_unlock(&ksm_mmlist_lock);
+	return true;
+}
+
+static struct rmap_item *scan_get_next_rmap_item(struct ksm_scan *scan,
+						 struct page **page)
 {
 	struct mm_struct *mm;
 	struct mm_slot *slot;
 	struct vm_area_struct *vma;
 	struct rmap_item *rmap_item;
+	struct rmap_item *stale = NULL;
+	bool last;
 
-	if (list_empty(&ksm_mm_head.mm_list))
-		return NULL;
-
-	slot = ksm_scan.mm_slot;
-	if (slot == &ksm_mm_head) {
-		root_unstable_tree = RB_ROOT;
-
-		spin_lock(&ksm_mmlist_lock);
-		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
-		ksm_scan.mm_slot = slot;
-		spin_unlock(&ksm_mmlist_lock);
 next_mm:
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
-	}
+	if (!scan->mm_slot && !ksm_scan_next_slot(scan))
+		return NULL;
+	slot = scan->mm_slot;
 
 	mm = slot->mm;
 	down_read(&mm->mmap_sem);
 	if (ksm_test_exit(mm))
 		vma = NULL;
 	else
-		vma = find_vma(mm, ksm_scan.address);
+		vma = find_vma(mm, scan->address);
 
 	for (; vma; vma = vma->vm_next) {
 		if (!(vma->vm_flags & VM_MERGEABLE))
 			continue;
-		if (ksm_scan.address < vma->vm_start)
-			ksm_scan.address = vma->vm_start;
+		if (scan->address < vma->vm_start)
+			scan->address = vma->vm_start;
 		if (!vma->anon_vma)
-			ksm_scan.address = vma->vm_end;
+			scan->address = vma->vm_end;
 
-		while (ksm_scan.address < vma->vm_end) {
+		while (scan->address < vma->vm_end) {
 			if (ksm_test_exit(mm))
 				break;
-			*page = follow_page(vma, ksm_scan.address, FOLL_GET);
+			*page = follow_page(vma, scan->address, FOLL_GET);
 			if (!IS_ERR_OR_NULL(*page) && PageAnon(*page)) {
-				flush_anon_page(vma, *page, ksm_scan.address);
+				flush_anon_page(vma, *page, scan->address);
 				flush_dcache_page(*page);
 				rmap_item = get_next_rmap_item(slot,
-					ksm_scan.rmap_list, ksm_scan.address);
+					scan->rmap_list, scan->address,
+					&stale);
 				if (rmap_item) {
-					ksm_scan.rmap_list =
+					scan->rmap_list =
 							&rmap_item->rmap_list;
-					ksm_scan.address += PAGE_SIZE;
+					scan->address += PAGE_SIZE;
 				} else
 					put_page(*page);
 				up_read(&mm->mmap_sem);
+				free_stale_rmap_items(&stale);
 				return rmap_item;
 			}
 			if (!IS_ERR_OR_NULL(*page))
 				put_page(*page);
-			ksm_scan.address += PAGE_SIZE;
+			scan->address += PAGE_SIZE;
 			cond_resched();
 		}
 	}
 
 	if (ksm_test_exit(mm)) {
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
 	}
 	/*
 	 * Nuke all the rmap_items that are above this current rmap:
 	 * because there were no VM_MERGEABLE vmas with such addresses.
 	 */
-	remove_trailing_rmap_items(slot, ksm_scan.rmap_list);
+	defer_rmap_items(scan->rmap_list, NULL, &stale);
 
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(slot->mm_list.next,
-						struct mm_slot, mm_list);
-	if (ksm_scan.address == 0) {
+	scan->mm_slot = NULL;
+	ksm_scans_busy--;
+	last = (ksm_next_slot == &ksm_mm_head);
+	if (scan->address == 0) {
 		/*
 		 * We've completed a full scan of all vmas, holding mmap_sem
 		 * throughout, and found no VM_MERGEABLE: so do the same as
@@ -1328,33 +1609,33 @@ next_mm:
 		free_mm_slot(slot);
 		clear_bit(MMF_VM_MERGEABLE, &mm->flags);
 		up_read(&mm->mmap_sem);
+		free_stale_rmap_items(&stale);
 		mmdrop(mm);
 	} else {
 		spin_unlock(&ksm_mmlist_lock);
 		up_read(&mm->mmap_sem);
+		free_stale_rmap_items(&stale);
 	}
 
-	/* Repeat until we've completed scanning the whole list */
-	slot = ksm_scan.mm_slot;
-	if (slot != &ksm_mm_head)
+	/* Repeat until all of this full scan has been handed out */
+	if (!last)
 		goto next_mm;
-
-	ksm_scan.seqnr++;
 	return NULL;
 }
 
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
+ * @scan - the cursor of the calling thread
  * @scan_npages - number of pages we want to scan before we return.
  */
-static void ksm_do_scan(unsigned int scan_npages)
+static void ksm_do_scan(struct ksm_scan *scan, unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
 
 	while (scan_npages--) {
 		cond_resched();
-		rmap_item = scan_get_next_rmap_item(&page);
+		rmap_item = scan_get_next_rmap_item(scan, &page);
 		if (!rmap_item)
 			return;
 		if (!PageKsm(page) || !in_stable_tree(rmap_item))
@@ -1368,15 +1649,21 @@ static int ksmd_should_run(void)
 	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
 }
 
-static int ksm_scan_thread(void *nothing)
+static int ksm_scan_thread(void *data)
 {
+	struct ksm_scan *scan = data;
+	u64 runtime;
+
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
-		mutex_lock(&ksm_thread_mutex);
+		runtime = task_sched_runtime(current);
+		down_read(&ksm_thread_sem);
 		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
-		mutex_unlock(&ksm_thread_mutex);
+			ksm_do_scan(scan, ksm_thread_pages_to_scan);
+		up_read(&ksm_thread_sem);
+		atomic64_add(task_sched_runtime(current) - runtime,
+			     &ksm_cpu_ns);
 
 		if (ksmd_should_run()) {
 			schedule_timeout_interruptible(
@@ -1389,6 +1676,48 @@ static int ksm_scan_thread(void *nothing)
 	return 0;
 }
 
+/*
+ * Start or stop ksmd threads until there are @nr of them. Stopped threads
+ * leave their cursor to be taken over by the others. Called under
+ * ksm_threads_mutex.
+ */
+static int ksm_set_nr_threads(unsigned int nr)
+{
+	struct task_struct *task;
+	int err = 0;
+
+	while (ksm_nr_threads < nr) {
+		unsigned int i = ksm_nr_threads;
+
+		if (i)
+			task = kthread_create(ksm_scan_thread, &ksm_scans[i],
+					      "ksmd/%u", i);
+		else
+			task = kthread_create(ksm_scan_thread, &ksm_scans[i],
+					      "ksmd");
+		if (IS_ERR(task)) {
+			err = PTR_ERR(task);
+			break;
+		}
+		spin_lock(&ksm_mmlist_lock);
+		ksm_threads[i] = task;
+		spin_unlock(&ksm_mmlist_lock);
+		wake_up_process(task);
+		ksm_nr_threads++;
+	}
+
+	while (ksm_nr_threads > nr) {
+		unsigned int i = --ksm_nr_threads;
+
+		kthread_stop(ksm_threads[i]);
+		spin_lock(&ksm_mmlist_lock);
+		ksm_threads[i] = NULL;
+		spin_unlock(&ksm_mmlist_lock);
+	}
+
+	return err;
+}
+
 int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags)
 {
@@ -1451,7 +1780,8 @@ int __ksm_enter(struct mm_struct *mm)
 	 * down a little; when fork is followed by immediate exec, we don't
 	 * want ksmd to waste time setting up and tearing down an rmap_list.
 	 */
-	list_add_tail(&mm_slot->mm_list, &ksm_scan.mm_slot->mm_list);
+	list_add_tail(&mm_slot->mm_list, &ksm_next_slot->mm_list);
+	ksm_restart_converge();
 	spin_unlock(&ksm_mmlist_lock);
 
 	set_bit(MMF_VM_MERGEABLE, &mm->flags);
@@ -1479,14 +1809,19 @@ void __ksm_exit(struct mm_struct *mm)
 
 	spin_lock(&ksm_mmlist_lock);
 	mm_slot = get_mm_slot(mm);
-	if (mm_slot && ksm_scan.mm_slot != mm_slot) {
+	if (mm_slot && !ksm_slot_busy(mm_slot)) {
+		if (ksm_next_slot == mm_slot)
+			ksm_next_slot = list_entry(mm_slot->mm_list.next,
+						   struct mm_slot, mm_list);
 		if (!mm_slot->rmap_list) {
 			hlist_del(&mm_slot->link);
 			list_del(&mm_slot->mm_list);
 			easy_to_free = 1;
 		} else {
-			list_move(&mm_slot->mm_list,
-				  &ksm_scan.mm_slot->mm_list);
+			/* Have it scanned next, to free its rmap_items */
+			list_move_tail(&mm_slot->mm_list,
+				       &ksm_next_slot->mm_list);
+			ksm_next_slot = mm_slot;
 		}
 	}
 	spin_unlock(&ksm_mmlist_lock);
@@ -1688,6 +2023,11 @@ void ksm_migrate_page(struct page *newpage, struct page *oldpage)
 	VM_BUG_ON(!PageLocked(newpage));
 	VM_BUG_ON(newpage->mapping != oldpage->mapping);
 
+	/*
+	 * The stable_node stays in the tree of the old node: its lock nests
+	 * outside the page lock. stable_tree_search() stops merging into it
+	 * if the new node is a different one.
+	 */
 	stable_node = page_stable_node(newpage);
 	if (stable_node) {
 		VM_BUG_ON(stable_node->kpfn != page_to_pfn(oldpage));
@@ -1701,14 +2041,18 @@ static struct stable_node *ksm_check_stable_tree(unsigned long start_pfn,
 						 unsigned long end_pfn)
 {
 	struct rb_node *node;
+	int nid;
 
-	for (node = rb_first(&root_stable_tree); node; node = rb_next(node)) {
-		struct stable_node *stable_node;
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		for (node = rb_first(&ksm_trees[nid].stable); node;
+		     node = rb_next(node)) {
+			struct stable_node *stable_node;
 
-		stable_node = rb_entry(node, struct stable_node, node);
-		if (stable_node->kpfn >= start_pfn &&
-		    stable_node->kpfn < end_pfn)
-			return stable_node;
+			stable_node = rb_entry(node, struct stable_node, node);
+			if (stable_node->kpfn >= start_pfn &&
+			    stable_node->kpfn < end_pfn)
+				return stable_node;
+		}
 	}
 	return NULL;
 }
@@ -1724,13 +2068,13 @@ static int ksm_memory_callback(struct notifier_block *self,
 		/*
 		 * Keep it very simple for now: just lock out ksmd and
 		 * MADV_UNMERGEABLE while any memory is going offline.
-		 * mutex_lock_nested() is necessary because lockdep was alarmed
-		 * that here we take ksm_thread_mutex inside notifier chain
+		 * down_write_nested() is necessary because lockdep was alarmed
+		 * that here we take ksm_thread_sem inside notifier chain
 		 * mutex, and later take notifier chain mutex inside
-		 * ksm_thread_mutex to unlock it.   But that's safe because both
+		 * ksm_thread_sem to unlock it.   But that's safe because both
 		 * are inside mem_hotplug_mutex.
 		 */
-		mutex_lock_nested(&ksm_thread_mutex, SINGLE_DEPTH_NESTING);
+		down_write_nested(&ksm_thread_sem, SINGLE_DEPTH_NESTING);
 		break;
 
 	case MEM_OFFLINE:
@@ -1745,7 +2089,7 @@ static int ksm_memory_callback(struct notifier_block *self,
 		/* fallthrough */
 
 	case MEM_CANCEL_OFFLINE:
-		mutex_unlock(&ksm_thread_mutex);
+		up_write(&ksm_thread_sem);
 		break;
 	}
 	return NOTIFY_OK;
@@ -1834,9 +2178,14 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 	 * on the list for when ksmd may be set running again).
 	 */
 
-	mutex_lock(&ksm_thread_mutex);
+	down_write(&ksm_thread_sem);
 	if (ksm_run != flags) {
 		ksm_run = flags;
+		if (flags & KSM_RUN_MERGE) {
+			spin_lock(&ksm_mmlist_lock);
+			ksm_restart_converge();
+			spin_unlock(&ksm_mmlist_lock);
+		}
 		if (flags & KSM_RUN_UNMERGE) {
 			current->flags |= PF_OOM_ORIGIN;
 			err = unmerge_and_remove_all_rmap_items();
@@ -1847,7 +2196,7 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 			}
 		}
 	}
-	mutex_unlock(&ksm_thread_mutex);
+	up_write(&ksm_thread_sem);
 
 	if (flags & KSM_RUN_MERGE)
 		wake_up_interruptible(&ksm_thread_wait);
@@ -1882,7 +2231,8 @@ static ssize_t pages_volatile_show(struct kobject *kobj,
 {
 	long ksm_pages_volatile;
 
-	ksm_pages_volatile = ksm_rmap_items - ksm_pages_shared
+	ksm_pages_volatile = atomic_long_read(&ksm_rmap_items)
+				- ksm_pages_shared
 				- ksm_pages_sharing - ksm_pages_unshared;
 	/*
 	 * It was not worth any locking to calculate that statistic,
@@ -1897,10 +2247,99 @@ KSM_ATTR_RO(pages_volatile);
 static ssize_t full_scans_show(struct kobject *kobj,
 			       struct kobj_attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", ksm_scan.seqnr);
+	return sprintf(buf, "%lu\n", ksm_seqnr);
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t scan_threads_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_nr_threads);
+}
+
+static ssize_t scan_threads_store(struct kobject *kobj,
+				 struct kobj_attribute *attr,
+				 const char *buf, size_t count)
+{
+	unsigned long nr;
+	int err;
+
+	err = strict_strtoul(buf, 10, &nr);
+	if (err || nr < 1 || nr > KSM_MAX_THREADS)
+		return -EINVAL;
+
+	mutex_lock(&ksm_threads_mutex);
+	err = ksm_set_nr_threads(nr);
+	mutex_unlock(&ksm_threads_mutex);
+
+	return err ? err : count;
+}
+KSM_ATTR(scan_threads);
+
+static ssize_t merge_across_nodes_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_merge_across_nodes);
+}
+
+static ssize_t merge_across_nodes_store(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					const char *buf, size_t count)
+{
+	unsigned long knob;
+	int err;
+
+	err = strict_strtoul(buf, 10, &knob);
+	if (err || knob > 1)
+		return -EINVAL;
+
+	/*
+	 * Pages already merged would stay merged across nodes, or stay in
+	 * trees no longer searched: only switch with nothing merged.
+	 */
+	down_write(&ksm_thread_sem);
+	if (ksm_merge_across_nodes != knob) {
+		if (ksm_pages_shared)
+			err = -EBUSY;
+		else
+			ksm_merge_across_nodes = knob;
+	}
+	up_write(&ksm_thread_sem);
+
+	return err ? err : count;
+}
+KSM_ATTR(merge_across_nodes);
+
+static ssize_t full_scan_msecs_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_last_scan_msecs);
+}
+KSM_ATTR_RO(full_scan_msecs);
+
+static ssize_t full_scan_cpu_msecs_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n", (unsigned long long)
+		       div_u64(ksm_last_scan_cpu_ns, NSEC_PER_MSEC));
+}
+KSM_ATTR_RO(full_scan_cpu_msecs);
+
+static ssize_t cpu_msecs_show(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n", (unsigned long long)
+		       div_u64(atomic64_read(&ksm_cpu_ns), NSEC_PER_MSEC));
+}
+KSM_ATTR_RO(cpu_msecs);
+
+static ssize_t converge_msecs_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_converge_msecs);
+}
+KSM_ATTR_RO(converge_msecs);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -1910,6 +2349,12 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&scan_threads_attr.attr,
+	&merge_across_nodes_attr.attr,
+	&full_scan_msecs_attr.attr,
+	&full_scan_cpu_msecs_attr.attr,
+	&cpu_msecs_attr.attr,
+	&converge_msecs_attr.attr,
 	NULL,
 };
 
@@ -1921,26 +2366,42 @@ static struct attribute_group ksm_attr_group = {
 
 static int __init ksm_init(void)
 {
-	struct task_struct *ksm_thread;
-	int err;
+	int err, nid;
 
 	err = ksm_slab_init();
 	if (err)
 		goto out;
 
-	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
-	if (IS_ERR(ksm_thread)) {
-		printk(KERN_ERR "ksm: creating kthread failed\n");
-		err = PTR_ERR(ksm_thread);
+	err = -ENOMEM;
+	ksm_trees = kcalloc(nr_node_ids, sizeof(*ksm_trees), GFP_KERNEL);
+	if (!ksm_trees)
 		goto out_free;
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		mutex_init(&ksm_trees[nid].lock);
+		ksm_trees[nid].stable = RB_ROOT;
+		ksm_trees[nid].unstable = RB_ROOT;
+	}
+
+	/* One thread per node to start with: they can use a tree each */
+	mutex_lock(&ksm_threads_mutex);
+	err = ksm_set_nr_threads(clamp_t(unsigned int, num_online_nodes(),
+					 1, KSM_MAX_THREADS));
+	if (err && ksm_nr_threads)
+		err = 0;
+	mutex_unlock(&ksm_threads_mutex);
+	if (err) {
+		printk(KERN_ERR "ksm: creating kthread failed\n");
+		goto out_free_trees;
 	}
 
 #ifdef CONFIG_SYSFS
 	err = sysfs_create_group(mm_kobj, &ksm_attr_group);
 	if (err) {
 		printk(KERN_ERR "ksm: register sysfs failed\n");
-		kthread_stop(ksm_thread);
-		goto out_free;
+		mutex_lock(&ksm_threads_mutex);
+		ksm_set_nr_threads(0);
+		mutex_unlock(&ksm_threads_mutex);
+		goto out_free_trees;
 	}
 #else
 	ksm_run = KSM_RUN_MERGE;	/* no way for user to start it */
@@ -1949,13 +2410,15 @@ static int __init ksm_init(void)
 
 #ifdef CONFIG_MEMORY_HOTREMOVE
 	/*
-	 * Choose a high priority since the callback takes ksm_thread_mutex:
+	 * Choose a high priority since the callback takes ksm_thread_sem:
 	 * later callbacks could only be taking locks which nest within that.
 	 */
 	hotplug_memory_notifier(ksm_memory_callback, 100);
 #endif
 	return 0;
 
+out_free_trees:
+	kfree(ksm_trees);
 out_free:
 	ksm_slab_free();
 out:
@@ -0,0 +1,499 @@
+/*
+ * linux/mm/lru_gen.c
+ *
+ * Multi-generational LRU: an alternative to the active/inactive lists
+ * for global page reclaim.
+ *
+ * The evictable pages of a zone are kept on per-generation lists. A new
+ * generation is started ("aging") by walking the page tables of every
+ * process and moving the pages found with the accessed bit set to it,
+ * which costs one pass over the page tables instead of an rmap walk per
+ * page scanned on the active list. Reclaim takes pages off the oldest
+ * generation, so pages that were not used for several aging rounds are
+ * evicted first; references found through rmap when a page is about to
+ * be evicted still move it to the youngest generation.
+ *
+ * The pages stay accounted to the active and inactive lists that page
+ * flags say they belong to, so the vmstat counters, memcg and the rest
+ * of the LRU code need not know about generations: only the list heads
+ * differ, see zone_lru_list() and zone_lru_evict_list().
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/mm_inline.h>
+#include <linux/pagevec.h>
+#include <linux/sched.h>
+#include <linux/hugetlb.h>
+#include <linux/mutex.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/init.h>
+
+#include <asm/tlbflush.h>
+
+#include "internal.h"
+
+unsigned long lru_gen_max_seq = MIN_NR_GENS;
+
+/* Serializes aging and switching between the reclaim modes */
+static DEFINE_MUTEX(lru_gen_mutex);
+
+#ifdef CONFIG_LRU_GEN_ENABLED
+static int lru_gen_enabled = 1;
+#else
+static int lru_gen_enabled;
+#endif
+
+/* All user mms, in the order their page tables are walked */
+static LIST_HEAD(lru_gen_mm_list);
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
+/* The mm being walked, if any: its exit waits for the walk to finish */
+static struct mm_struct *lru_gen_mm_walking;
+
+struct lru_gen_walk {
+	struct vm_area_struct *vma;
+	struct pagevec pvec;
+};
+
+void lru_gen_init_zone(struct zone *zone)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	int gen, file;
+
+	lrugen->enabled = 0;
+	for (file = 0; file < 2; file++) {
+		lrugen->min_seq[file] = lru_gen_max_seq;
+		for (gen = 0; gen < MAX_NR_GENS; gen++)
+			INIT_LIST_HEAD(&lrugen->lists[gen][file]);
+	}
+}
+
+/*
+ * Skip the oldest generations of a type once reclaim has emptied them.
+ * Must be called with the zone's lru_lock held.
+ */
+void lru_gen_update_min_seq(struct zone *zone, int file)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	unsigned long max_seq = ACCESS_ONCE(lru_gen_max_seq);
+
+	while (lrugen->min_seq[file] < max_seq &&
+	       list_empty(&lrugen->lists[lru_gen_from_seq(
+					lrugen->min_seq[file])][file]))
+		lrugen->min_seq[file]++;
+}
+
+/*
+ * Reclaim should start a new generation before it evicts pages of this
+ * type from the zone: fewer than MIN_NR_GENS + 1 are left.
+ */
+int lru_gen_need_aging(struct zone *zone, int file)
+{
+	int ret = 0;
+
+	spin_lock_irq(&zone->lru_lock);
+	if (lru_gen_zone_enabled(zone)) {
+		lru_gen_update_min_seq(zone, file);
+		ret = zone->lrugen.min_seq[file] + MIN_NR_GENS >
+			lru_gen_max_seq;
+	}
+	spin_unlock_irq(&zone->lru_lock);
+	return ret;
+}
+
+/*
+ * Called once an mm is set up far enough that it is only ever released
+ * through mmput(): the error paths of dup_mm() and bprm_mm_init() free
+ * it with a bare mmdrop(), which doesn't take it off the list.
+ */
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	mm->lru_gen_seq = ACCESS_ONCE(lru_gen_max_seq);
+	spin_lock(&lru_gen_mm_lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+/*
+ * Called when the last user of @mm is gone, before its page tables are
+ * freed: the walk only holds mmap_sem and a reference on mm_count.
+ * An mm that was never added is on no list, which is fine.
+ */
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	int walking;
+
+	spin_lock(&lru_gen_mm_lock);
+	list_del_init(&mm->lru_gen_list);
+	walking = lru_gen_mm_walking == mm;
+	spin_unlock(&lru_gen_mm_lock);
+
+	if (walking) {
+		down_write(&mm->mmap_sem);
+		up_write(&mm->mmap_sem);
+	}
+}
+
+/*
+ * Move the pages whose accessed bit was found set to the youngest
+ * generation of their zone, and drop the references taken on them.
+ */
+static void lru_gen_promote(struct pagevec *pvec)
+{
+	struct zone *zone = NULL;
+	int pgmoved = 0;
+	int i;
+
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+		struct zone *pagezone = page_zone(page);
+		enum lru_list lru;
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irq(&zone->lru_lock);
+			zone = pagezone;
+			spin_lock_irq(&zone->lru_lock);
+		}
+		if (!PageLRU(page) || PageUnevictable(page) ||
+		    !lru_gen_zone_enabled(zone))
+			continue;
+
+		lru = page_lru(page);
+		del_page_from_lru_list(zone, page, lru);
+		if (!PageActive(page)) {
+			SetPageActive(page);
+			lru += LRU_ACTIVE;
+			__count_vm_event(PGACTIVATE);
+		}
+		add_page_to_lru_list(zone, page, lru);
+		zone->reclaim_stat.recent_rotated[is_file_lru(lru)]++;
+		pgmoved++;
+	}
+	if (zone)
+		spin_unlock_irq(&zone->lru_lock);
+
+	count_vm_events(LRU_GEN_PROMOTE, pgmoved);
+	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	pagevec_reinit(pvec);
+}
+
+static void lru_gen_walk_add(struct lru_gen_walk *lgw, struct page *page)
+{
+	if (!PageLRU(page))
+		return;
+	get_page(page);
+	if (!pagevec_add(&lgw->pvec, page))
+		lru_gen_promote(&lgw->pvec);
+}
+
+static int lru_gen_pte_range(pmd_t *pmd, unsigned long addr,
+			     unsigned long end, struct mm_walk *walk)
+{
+	struct lru_gen_walk *lgw = walk->private;
+	struct vm_area_struct *vma = lgw->vma;
+	pte_t *pte;
+	spinlock_t *ptl;
+	struct page *page;
+	pmd_t pmdval;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (pmd_trans_huge(*pmd)) {
+		spin_lock(&walk->mm->page_table_lock);
+		if (pmd_trans_huge(*pmd)) {
+			if (pmdp_test_and_clear_young(vma, addr, pmd)) {
+				page = pmd_page(*pmd);
+				if (PageAnon(page)) {
+					lru_gen_walk_add(lgw, page);
+				} else {
+					/* shmem: small page cache pages */
+					for (; addr != end; addr += PAGE_SIZE)
+						lru_gen_walk_add(lgw, page++);
+				}
+			}
+			spin_unlock(&walk->mm->page_table_lock);
+			cond_resched();
+			return 0;
+		}
+		spin_unlock(&walk->mm->page_table_lock);
+	}
+#endif
+
+	/* A split of a shmem pmd leaves it empty until the next fault */
+	pmdval = *pmd;
+	barrier();
+	if (pmd_none(pmdval) || pmd_trans_huge(pmdval))
+		return 0;
+
+	pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		if (!pte_present(*pte))
+			continue;
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page)
+			continue;
+		if (ptep_test_and_clear_young(vma, addr, pte))
+			lru_gen_walk_add(lgw, page);
+	}
+	pte_unmap_unlock(pte - 1, ptl);
+	cond_resched();
+	return 0;
+}
+
+static void lru_gen_walk_mm(struct mm_struct *mm)
+{
+	struct lru_gen_walk lgw;
+	struct mm_walk walk = {
+		.pmd_entry = lru_gen_pte_range,
+		.mm = mm,
+		.private = &lgw,
+	};
+	struct vm_area_struct *vma;
+
+	/* Reclaim must not wait for a task that is changing its mappings */
+	if (!down_read_trylock(&mm->mmap_sem))
+		return;
+	if (!atomic_read(&mm->mm_users))
+		goto out;
+
+	pagevec_init(&lgw.pvec, 0);
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (vma->vm_flags & (VM_LOCKED | VM_IO | VM_PFNMAP))
+			continue;
+		if (is_vm_hugetlb_page(vma))
+			continue;
+		lgw.vma = vma;
+		walk_page_range(vma->vm_start, vma->vm_end, &walk);
+	}
+	flush_tlb_mm(mm);
+	if (pagevec_count(&lgw.pvec))
+		lru_gen_promote(&lgw.pvec);
+out:
+	up_read(&mm->mmap_sem);
+}
+
+/*
+ * Walk every mm not yet walked for generation @seq. Walked mms go to
+ * the tail of the list, so the walk is done when the head has @seq;
+ * mms created meanwhile start out with @seq and are skipped.
+ */
+static void lru_gen_walk_mms(unsigned long seq)
+{
+	struct mm_struct *mm;
+
+	spin_lock(&lru_gen_mm_lock);
+	while (!list_empty(&lru_gen_mm_list)) {
+		mm = list_first_entry(&lru_gen_mm_list, struct mm_struct,
+				      lru_gen_list);
+		if (mm->lru_gen_seq == seq)
+			break;
+		mm->lru_gen_seq = seq;
+		list_move_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+
+		atomic_inc(&mm->mm_count);
+		lru_gen_mm_walking = mm;
+		spin_unlock(&lru_gen_mm_lock);
+
+		lru_gen_walk_mm(mm);
+
+		spin_lock(&lru_gen_mm_lock);
+		lru_gen_mm_walking = NULL;
+		spin_unlock(&lru_gen_mm_lock);
+		mmdrop(mm);
+		cond_resched();
+		spin_lock(&lru_gen_mm_lock);
+	}
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+/*
+ * Make room for generation @seq: a type that already has MAX_NR_GENS
+ * generations has its two oldest merged.
+ */
+static void lru_gen_fold(struct zone *zone, unsigned long seq)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	int file;
+
+	for (file = 0; file < 2; file++) {
+		while (seq - lrugen->min_seq[file] >= MAX_NR_GENS) {
+			unsigned long min_seq = lrugen->min_seq[file];
+
+			list_splice_tail_init(
+				&lrugen->lists[lru_gen_from_seq(min_seq)][file],
+				&lrugen->lists[lru_gen_from_seq(min_seq + 1)][file]);
+			lrugen->min_seq[file]++;
+		}
+	}
+}
+
+/**
+ * lru_gen_age - start a new generation
+ *
+ * Called by reclaim when a zone runs short of generations to evict
+ * from. Only one task ages at a time, the others go on evicting.
+ */
+void lru_gen_age(void)
+{
+	struct zone *zone;
+	unsigned long seq;
+
+	if (!mutex_trylock(&lru_gen_mutex))
+		return;
+
+	seq = lru_gen_max_seq + 1;
+	for_each_zone(zone) {
+		spin_lock_irq(&zone->lru_lock);
+		if (lru_gen_zone_enabled(zone))
+			lru_gen_fold(zone, seq);
+		spin_unlock_irq(&zone->lru_lock);
+	}
+	/* Pages added from here on may go to the new generation */
+	lru_gen_max_seq = seq;
+	count_vm_event(LRU_GEN_AGE);
+
+	lru_gen_walk_mms(seq);
+	mutex_unlock(&lru_gen_mutex);
+}
+
+/*
+ * Switching modes moves the zone's pages between the active/inactive
+ * and the generation lists: active pages start out in the youngest
+ * generation, inactive ones in the one before.
+ */
+static void lru_gen_fill_zone(struct zone *zone)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	unsigned long max_seq = lru_gen_max_seq;
+	int file;
+
+	for (file = 0; file < 2; file++) {
+		enum lru_list l = LRU_FILE * file;
+
+		list_splice_init(&zone->lru[l + LRU_ACTIVE].list,
+				 &lrugen->lists[lru_gen_from_seq(max_seq)][file]);
+		list_splice_init(&zone->lru[l].list,
+				 &lrugen->lists[lru_gen_from_seq(max_seq - 1)][file]);
+		lrugen->min_seq[file] = max_seq - 1;
+	}
+	lrugen->enabled = 1;
+}
+
+static void lru_gen_drain_zone(struct zone *zone)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	unsigned long max_seq = lru_gen_max_seq;
+	struct page *page, *next;
+	int i, file;
+
+	/* Youngest first, keeping the order within each generation */
+	for (file = 0; file < 2; file++) {
+		for (i = 0; i < MAX_NR_GENS; i++) {
+			struct list_head *list;
+
+			list = &lrugen->lists[lru_gen_from_seq(max_seq - i)][file];
+			list_for_each_entry_safe(page, next, list, lru)
+				list_move_tail(&page->lru,
+					       &zone->lru[page_lru(page)].list);
+		}
+		lrugen->min_seq[file] = max_seq;
+	}
+	lrugen->enabled = 0;
+}
+
+/* Must be called with lru_gen_mutex held */
+static void lru_gen_change_state(int enable)
+{
+	struct zone *zone;
+
+	if (enable == lru_gen_enabled)
+		return;
+
+	for_each_zone(zone) {
+		spin_lock_irq(&zone->lru_lock);
+		if (enable)
+			lru_gen_fill_zone(zone);
+		else
+			lru_gen_drain_zone(zone);
+		spin_unlock_irq(&zone->lru_lock);
+		cond_resched();
+	}
+	lru_gen_enabled = enable;
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", lru_gen_enabled);
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	unsigned long enable;
+	int err;
+
+	err = strict_strtoul(buf, 10, &enable);
+	if (err || enable > 1)
+		return -EINVAL;
+
+	mutex_lock(&lru_gen_mutex);
+	lru_gen_change_state(enable);
+	mutex_unlock(&lru_gen_mutex);
+
+	return count;
+}
+static struct kobj_attribute enabled_attr =
+	__ATTR(enabled, 0644, enabled_show, enabled_store);
+
+static ssize_t max_seq_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ACCESS_ONCE(lru_gen_max_seq));
+}
+static struct kobj_attribute max_seq_attr = __ATTR_RO(max_seq);
+
+static struct attribute *lru_gen_attrs[] = {
+	&enabled_attr.attr,
+	&max_seq_attr.attr,
+	NULL,
+};
+
+static struct attribute_group lru_gen_attr_group = {
+	.attrs = lru_gen_attrs,
+	.name = "lru_gen",
+};
+#endif /* CONFIG_SYSFS */
+
+static int __init lru_gen_init(void)
+{
+	int enable = lru_gen_enabled;
+
+	/* Pages allocated during boot are on the active/inactive lists */
+	lru_gen_enabled = 0;
+	mutex_lock(&lru_gen_mutex);
+	lru_gen_change_state(enable);
+	mutex_unlock(&lru_gen_mutex);
+
+#ifdef CONFIG_SYSFS
+	if (sysfs_create_group(mm_kobj, &lru_gen_attr_group))
+		printk(KERN_ERR "lru_gen: register sysfs failed\n");
+#endif
+	return 0;
+}
+module_init(lru_gen_init)
+
+static int __init setup_lru_gen(char *str)
+{
+	lru_gen_enabled = !!simple_strtoul(str, NULL, 0);
+	return 1;
+}
+__setup("lru_gen=", setup_lru_gen);
@@ -514,6 +514,7 @@ static inline int check_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
+		split_huge_page_pmd(vma->vm_mm, pmd);
 		if (pmd_none_or_clear_bad(pmd))
 			continue;
 		if (check_pte_range(vma, pmd, addr, next, nodes,
@@ -1796,7 +1797,7 @@ static struct page *alloc_page_interleave(gfp_t gfp, unsigned order,
 }
 
 /**
- * 	alloc_page_vma	- Allocate a page for a VMA.
+ * 	alloc_pages_vma	- Allocate a page for a VMA.
  *
  * 	@gfp:
  *      %GFP_USER    user allocation.
@@ -1805,6 +1806,7 @@ static struct page *alloc_page_interleave(gfp_t gfp, unsigned order,
  *      %GFP_FS      allocation should not call back into a file system.
  *      %GFP_ATOMIC  don't sleep.
  *
+ *	@order: Order of the GFP allocation.
  * 	@vma:  Pointer to VMA or NULL if not available.
  *	@addr: Virtual Address of the allocation. Must be inside the VMA.
  *
@@ -1818,7 +1820,8 @@ static struct page *alloc_page_interleave(gfp_t gfp, unsigned order,
  *	Should be called with the mm_sem of the vma hold.
  */
 struct page *
-alloc_page_vma(gfp_t gfp, struct vm_area_struct *vma, unsigned long addr)
+alloc_pages_vma(gfp_t gfp, int order, struct vm_area_struct *vma,
+		unsigned long addr)
 {
 	struct mempolicy *pol = get_vma_policy(current, vma, addr);
 	struct zonelist *zl;
@@ -1828,9 +1831,9 @@ alloc_page_vma(gfp_t gfp, struct vm_area_struct *vma, unsigned long addr)
 	if (unlikely(pol->mode == MPOL_INTERLEAVE)) {
 		unsigned nid;
 
-		nid = interleave_nid(pol, vma, addr, PAGE_SHIFT);
+		nid = interleave_nid(pol, vma, addr, PAGE_SHIFT + order);
 		mpol_cond_put(pol);
-		page = alloc_page_interleave(gfp, 0, nid);
+		page = alloc_page_interleave(gfp, order, nid);
 		put_mems_allowed();
 		return page;
 	}
@@ -1839,7 +1842,7 @@ alloc_page_vma(gfp_t gfp, struct vm_area_struct *vma, unsigned long addr)
 		/*
 		 * slow path: ref counted shared policy
 		 */
-		struct page *page =  __alloc_pages_nodemask(gfp, 0,
+		struct page *page =  __alloc_pages_nodemask(gfp, order,
 						zl, policy_nodemask(gfp, pol));
 		__mpol_put(pol);
 		put_mems_allowed();
@@ -1848,7 +1851,8 @@ alloc_page_vma(gfp_t gfp, struct vm_area_struct *vma, unsigned long addr)
 	/*
 	 * fast path:  default or task policy
 	 */
-	page = __alloc_pages_nodemask(gfp, 0, zl, policy_nodemask(gfp, pol));
+	page = __alloc_pages_nodemask(gfp, order, zl,
+				      policy_nodemask(gfp, pol));
 	put_mems_allowed();
 	return page;
 }
@@ -2281,6 +2285,112 @@ void numa_default_policy(void)
 	do_set_mempolicy(MPOL_DEFAULT, 0, NULL);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/**
+ * mpol_misplaced - check whether a page is on the node it should be on
+ * @page: page that took a NUMA hinting fault
+ * @vma: vma the fault happened in
+ * @addr: faulting address
+ *
+ * Only memory allocated under the default, local, policy follows the tasks
+ * that use it: explicit task, vma or shared policies are left to place the
+ * page as they see fit, as is a node outside the task's cpuset.
+ *
+ * Returns the node the page should be moved to, or -1 if it is fine
+ * where it is.
+ */
+int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+		   unsigned long addr)
+{
+	struct mempolicy *pol = get_vma_policy(current, vma, addr);
+	int thisnid = numa_node_id();
+	int ret = -1;
+
+	if (pol != &default_policy &&
+	    !(pol->mode == MPOL_PREFERRED && (pol->flags & MPOL_F_LOCAL)))
+		goto out;
+	if (page_to_nid(page) == thisnid)
+		goto out;
+	if (!node_isset(thisnid, cpuset_current_mems_allowed))
+		goto out;
+	ret = thisnid;
+out:
+	mpol_cond_put(pol);
+	return ret;
+}
+
+struct numa_walk {
+	struct vm_area_struct *vma;
+	unsigned long nr_updated;
+};
+
+static int change_prot_numa_pmd(pmd_t *pmd, unsigned long addr,
+				unsigned long end, struct mm_walk *walk)
+{
+	struct numa_walk *nw = walk->private;
+	struct vm_area_struct *vma = nw->vma;
+	struct mm_struct *mm = walk->mm;
+	pte_t *orig_pte, *pte, ptent;
+	spinlock_t *ptl;
+	struct page *page;
+
+	/* Huge pmds are not marked, they would have to be split */
+	if (pmd_trans_huge(*pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	arch_enter_lazy_mmu_mode();
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+		if (!pte_present(ptent) || pte_numa(ptent))
+			continue;
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page || PageKsm(page))
+			continue;
+
+		ptent = ptep_modify_prot_start(mm, addr, pte);
+		ptent = pte_mknuma(ptent);
+		ptep_modify_prot_commit(mm, addr, pte, ptent);
+		nw->nr_updated++;
+	}
+	arch_leave_lazy_mmu_mode();
+	pte_unmap_unlock(orig_pte, ptl);
+	return 0;
+}
+
+/**
+ * change_prot_numa - mark a range for NUMA hinting faults
+ * @vma: vma the range is in
+ * @start: start of the range
+ * @end: end of the range
+ *
+ * Makes the ptes of all normal pages in the range inaccessible, so that
+ * the next access to each page is reported through do_numa_page().
+ * Caller holds mmap_sem for reading.
+ *
+ * Returns the number of ptes that were changed.
+ */
+unsigned long change_prot_numa(struct vm_area_struct *vma,
+			       unsigned long start, unsigned long end)
+{
+	struct numa_walk nw = {
+		.vma = vma,
+	};
+	struct mm_walk numa_walk = {
+		.pmd_entry = change_prot_numa_pmd,
+		.mm = vma->vm_mm,
+		.private = &nw,
+	};
+
+	walk_page_range(start, end, &numa_walk);
+	if (nw.nr_updated) {
+		flush_tlb_range(vma, start, end);
+		count_vm_events(NUMA_PTE_UPDATES, nw.nr_updated);
+	}
+	return nw.nr_updated;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /*
  * Parse and format mempolicy from/to strings
  */
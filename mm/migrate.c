@@ -113,7 +113,7 @@ static int remove_migration_pte(struct page *new, struct vm_area_struct *vma,
 			goto out;
 
 		pmd = pmd_offset(pud, addr);
-		if (!pmd_present(*pmd))
+		if (!pmd_present(*pmd) || pmd_trans_huge(*pmd))
 			goto out;
 
 		ptep = pte_offset_map(pmd, addr);
@@ -656,6 +656,10 @@ static int unmap_and_move(new_page_t get_new_page, unsigned long private,
 		goto unlock;
 	}
 
+	/* only small pages are migrated: try_to_unmap() can't see a pmd */
+	if (unlikely(PageTransHuge(page)) && split_huge_page(page))
+		goto unlock;
+
 	/* charge against new page */
 	charge = mem_cgroup_prepare_migration(page, newpage, &mem);
 	if (charge == -ENOMEM) {
@@ -1352,4 +1356,52 @@ int migrate_vmas(struct mm_struct *mm, const nodemask_t *to,
  	}
  	return err;
 }
+
+#ifdef CONFIG_NUMA_BALANCING
+static struct page *alloc_misplaced_dst_page(struct page *page,
+					     unsigned long data,
+					     int **result)
+{
+	int nid = (int) data;
+
+	/*
+	 * Only take free memory on the target node: a misplaced page is
+	 * better left where it is than pushing the node into reclaim.
+	 */
+	return alloc_pages_exact_node(nid, GFP_HIGHUSER_MOVABLE |
+				      __GFP_THISNODE | __GFP_NOMEMALLOC |
+				      __GFP_NORETRY | __GFP_NOWARN, 0);
+}
+
+/**
+ * migrate_misplaced_page - move a page to the node it is used from
+ * @page: page that took a NUMA hinting fault
+ * @node: node to move it to
+ *
+ * The caller holds mmap_sem for reading and a reference to @page, which
+ * is consumed here: migration only succeeds when the page is referenced
+ * by nothing but its mappings and the lru isolation.
+ * Returns 1 if the page was migrated, 0 if it stays where it is.
+ */
+int migrate_misplaced_page(struct page *page, int node)
+{
+	LIST_HEAD(migratepages);
+
+	if (isolate_lru_page(page)) {
+		put_page(page);
+		return 0;
+	}
+	/* the isolation holds the page now */
+	put_page(page);
+
+	inc_zone_page_state(page, NR_ISOLATED_ANON + page_is_file_cache(page));
+	list_add(&page->lru, &migratepages);
+	if (migrate_pages(&migratepages, alloc_misplaced_dst_page, node, 0)) {
+		putback_lru_pages(&migratepages);
+		return 0;
+	}
+	count_vm_event(NUMA_PAGE_MIGRATE);
+	return 1;
+}
+#endif /* CONFIG_NUMA_BALANCING */
 #endif
@@ -2173,6 +2173,156 @@ __alloc_pages_nodemask(gfp_t gfp_mask, unsigned int order,
 }
 EXPORT_SYMBOL(__alloc_pages_nodemask);
 
+/*
+ * __alloc_pages_bulk_nodemask - allocate a number of order-0 pages
+ * @gfp_mask: GFP flags for the allocation
+ * @zonelist: zonelist to allocate from
+ * @nodemask: set of nodes to allocate from, may be NULL
+ * @nr_pages: the number of pages requested
+ * @page_list: list to add the pages to, or NULL if @page_array is used
+ * @page_array: array to fill, only NULL entries are filled in
+ *
+ * Batch consumers such as network receive refill want many pages at once.
+ * Rather than paying the full allocator entry and a per cpu pages pass
+ * for every single page, pick one zone that is comfortably above its low
+ * watermark for the whole batch and take the pages off this cpu's pcp
+ * list in one go with interrupts disabled, refilling the list from the
+ * buddy lists with rmqueue_bulk() as needed.
+ *
+ * This is an opportunistic fast path: it does not reclaim, compact or
+ * fall back to other zones for the batch. If no page at all could be
+ * taken that way, a single page is allocated through the regular
+ * allocator so that callers still make progress under memory pressure.
+ *
+ * Returns the number of pages on the list, or the number of leading
+ * populated entries in the array.
+ */
+unsigned long __alloc_pages_bulk_nodemask(gfp_t gfp_mask,
+					  struct zonelist *zonelist,
+					  nodemask_t *nodemask,
+					  unsigned long nr_pages,
+					  struct list_head *page_list,
+					  struct page **page_array)
+{
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	int migratetype = allocflags_to_migratetype(gfp_mask);
+	int cold = !!(gfp_mask & __GFP_COLD);
+	struct zone *preferred_zone, *zone;
+	struct per_cpu_pages *pcp;
+	struct list_head *list;
+	struct zoneref *z;
+	struct page *page;
+	unsigned long flags;
+	unsigned long nr_populated = 0;
+	unsigned long nr_account = 0;
+
+	if (unlikely(nr_pages == 0))
+		return 0;
+
+	/* Skip populated array elements */
+	while (page_array && nr_populated < nr_pages &&
+	       page_array[nr_populated])
+		nr_populated++;
+
+	if (nr_populated == nr_pages)
+		return nr_populated;
+
+	/* Use the regular allocator for a single page */
+	if (nr_pages - nr_populated == 1)
+		goto failed;
+
+	gfp_mask &= gfp_allowed_mask;
+	if (should_fail_alloc_page(gfp_mask, 0))
+		goto failed;
+	if (unlikely(!zonelist->_zonerefs->zone))
+		goto failed;
+
+	get_mems_allowed();
+	first_zones_zonelist(zonelist, high_zoneidx, nodemask, &preferred_zone);
+	if (!preferred_zone)
+		goto failed_put;
+
+	/* Find an allowed local zone that has room for the whole batch */
+	for_each_zone_zonelist_nodemask(zone, z, zonelist,
+					high_zoneidx, nodemask) {
+		unsigned long mark;
+
+		if (!cpuset_zone_allowed_hardwall(zone, gfp_mask))
+			continue;
+		if (zone_to_nid(zone) != zone_to_nid(preferred_zone))
+			break;
+
+		mark = low_wmark_pages(zone) + nr_pages;
+		if (zone_watermark_ok(zone, 0, mark, zone_idx(preferred_zone),
+				      ALLOC_WMARK_LOW))
+			goto found;
+	}
+	goto failed_put;
+
+found:
+	local_irq_save(flags);
+	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	list = &pcp->lists[migratetype];
+
+	while (nr_populated < nr_pages) {
+		/* Skip populated array elements */
+		if (page_array && page_array[nr_populated]) {
+			nr_populated++;
+			continue;
+		}
+
+		if (list_empty(list)) {
+			pcp->count += rmqueue_bulk(zone, 0, pcp->batch, list,
+						   migratetype, cold);
+			if (unlikely(list_empty(list)))
+				break;
+		}
+
+		if (cold)
+			page = list_entry(list->prev, struct page, lru);
+		else
+			page = list_entry(list->next, struct page, lru);
+		list_del(&page->lru);
+		pcp->count--;
+		nr_account++;
+
+		zone_statistics(preferred_zone, zone);
+		VM_BUG_ON(bad_range(zone, page));
+		/* A bad page is left alone, just like buffered_rmqueue() does */
+		if (prep_new_page(page, 0, gfp_mask))
+			continue;
+		trace_mm_page_alloc(page, 0, gfp_mask, migratetype);
+
+		if (page_list)
+			list_add_tail(&page->lru, page_list);
+		else
+			page_array[nr_populated] = page;
+		nr_populated++;
+	}
+
+	__count_zone_vm_events(PGALLOC, zone, nr_account);
+	local_irq_restore(flags);
+	put_mems_allowed();
+
+	if (nr_account)
+		return nr_populated;
+	goto failed;
+
+failed_put:
+	put_mems_allowed();
+failed:
+	page = __alloc_pages_nodemask(gfp_mask, 0, zonelist, nodemask);
+	if (page) {
+		if (page_list)
+			list_add_tail(&page->lru, page_list);
+		else
+			page_array[nr_populated] = page;
+		nr_populated++;
+	}
+	return nr_populated;
+}
+EXPORT_SYMBOL(__alloc_pages_bulk_nodemask);
+
 /*
  * Common helper functions.
  */
@@ -4150,6 +4300,7 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 			INIT_LIST_HEAD(&zone->lru[l].list);
 			zone->reclaim_stat.nr_saved_scan[l] = 0;
 		}
+		lru_gen_init_zone(zone);
 		zone->reclaim_stat.recent_rotated[0] = 0;
 		zone->reclaim_stat.recent_rotated[1] = 0;
 		zone->reclaim_stat.recent_scanned[0] = 0;
@@ -34,6 +34,19 @@ static int walk_pmd_range(pud_t *pud, unsigned long addr, unsigned long end,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
+		if (pmd_trans_huge(*pmd)) {
+			/*
+			 * A pmd_entry handler copes with huge pmds on its
+			 * own; pte_entry walkers only ever see small pages.
+			 */
+			if (walk->pmd_entry) {
+				err = walk->pmd_entry(pmd, addr, next, walk);
+				if (err)
+					break;
+				continue;
+			}
+			split_huge_page_pmd(walk->mm, pmd);
+		}
 		if (pmd_none_or_clear_bad(pmd)) {
 			if (walk->pte_hole)
 				err = walk->pte_hole(addr, next, walk);
@@ -0,0 +1,360 @@
+/*
+ * linux/mm/process_vm_access.c
+ *
+ * Cross memory attach: process_vm_readv() and process_vm_writev() copy
+ * data directly between the address space of the caller and that of
+ * another process, without going through a pipe, shared memory or
+ * ptrace peeks and pokes.
+ *
+ * The remote pages are pinned with get_user_pages() a batch at a time
+ * and copied to or from the local iovecs with the usual user copy
+ * routines, so the copy happens once and faults on the local side are
+ * handled as for any other syscall.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/mm.h>
+#include <linux/uio.h>
+#include <linux/sched.h>
+#include <linux/highmem.h>
+#include <linux/ptrace.h>
+#include <linux/slab.h>
+#include <linux/syscalls.h>
+
+#ifdef CONFIG_COMPAT
+#include <linux/compat.h>
+#endif
+
+/* Remote pages pinned at a time without allocating the page array */
+#define PVM_MAX_PP_ARRAY_COUNT	16
+
+/* Upper bound on the remote pages pinned at a time */
+#define PVM_MAX_PAGES		(PAGE_SIZE / sizeof(struct page *))
+
+/* Position in the local iovecs */
+struct pvm_iter {
+	const struct iovec *iov;
+	unsigned long nr_segs;
+	unsigned long seg;
+	size_t offset;
+};
+
+/*
+ * Copy @len bytes starting at @offset into the first of the pinned
+ * remote @pages to (or, if @vm_write, from) the local iovecs. Stops
+ * early when the local iovecs are used up.
+ */
+static int process_vm_rw_pages(struct page **pages, unsigned long offset,
+			       size_t len, struct pvm_iter *it, int vm_write,
+			       ssize_t *copied)
+{
+	while (len && it->seg < it->nr_segs) {
+		const struct iovec *iov = &it->iov[it->seg];
+		void __user *ubuf = iov->iov_base + it->offset;
+		size_t copy = min_t(size_t, PAGE_SIZE - offset, len);
+		unsigned long left;
+		char *kaddr;
+
+		copy = min_t(size_t, copy, iov->iov_len - it->offset);
+		if (copy) {
+			kaddr = kmap(*pages);
+			if (vm_write) {
+				left = copy_from_user(kaddr + offset, ubuf,
+						      copy);
+				set_page_dirty_lock(*pages);
+			} else {
+				left = copy_to_user(ubuf, kaddr + offset, copy);
+			}
+			kunmap(*pages);
+
+			*copied += copy - left;
+			if (left)
+				return -EFAULT;
+
+			len -= copy;
+			offset += copy;
+			if (offset == PAGE_SIZE) {
+				pages++;
+				offset = 0;
+			}
+			it->offset += copy;
+		}
+		if (it->offset == iov->iov_len) {
+			it->seg++;
+			it->offset = 0;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Copy one remote iovec, pinning at most @max_pages of its pages at a
+ * time into @pages.
+ */
+static int process_vm_rw_single_vec(unsigned long addr, unsigned long len,
+				    struct page **pages,
+				    unsigned long max_pages,
+				    struct pvm_iter *it,
+				    struct task_struct *task,
+				    struct mm_struct *mm, int vm_write,
+				    ssize_t *copied)
+{
+	unsigned long pa = addr & PAGE_MASK;
+	unsigned long offset = addr - pa;
+	unsigned long nr_pages;
+	size_t bytes;
+	int pinned, i, rc;
+
+	if (!len)
+		return 0;
+	nr_pages = (addr + len - 1) / PAGE_SIZE - addr / PAGE_SIZE + 1;
+
+	while (nr_pages && it->seg < it->nr_segs) {
+		pinned = min(nr_pages, max_pages);
+
+		down_read(&mm->mmap_sem);
+		pinned = get_user_pages(task, mm, pa, pinned, vm_write, 0,
+					pages, NULL);
+		up_read(&mm->mmap_sem);
+		if (pinned <= 0)
+			return -EFAULT;
+
+		bytes = min_t(size_t, pinned * PAGE_SIZE - offset, len);
+		rc = process_vm_rw_pages(pages, offset, bytes, it, vm_write,
+					 copied);
+		for (i = 0; i < pinned; i++)
+			put_page(pages[i]);
+		if (rc)
+			return rc;
+
+		len -= bytes;
+		offset = 0;
+		nr_pages -= pinned;
+		pa += pinned * PAGE_SIZE;
+	}
+	return 0;
+}
+
+/*
+ * Both iovec arrays have been copied in and checked; the local one
+ * against our address space, the remote one only for its lengths.
+ * Returns the number of bytes copied, or an error if nothing was.
+ */
+static ssize_t process_vm_rw_core(pid_t pid, const struct iovec *lvec,
+				  unsigned long liovcnt,
+				  const struct iovec *rvec,
+				  unsigned long riovcnt,
+				  unsigned long flags, int vm_write)
+{
+	struct page *pp_stack[PVM_MAX_PP_ARRAY_COUNT];
+	struct page **pages = pp_stack;
+	unsigned long max_pages = 0, nr_pages;
+	struct pvm_iter it = {
+		.iov = lvec,
+		.nr_segs = liovcnt,
+	};
+	struct task_struct *task;
+	struct mm_struct *mm;
+	ssize_t copied = 0;
+	unsigned long i;
+	ssize_t rc = 0;
+
+	/* Size the page array for the largest remote iovec */
+	for (i = 0; i < riovcnt; i++) {
+		unsigned long start = (unsigned long)rvec[i].iov_base;
+		unsigned long len = rvec[i].iov_len;
+
+		if (!len)
+			continue;
+		if (start + len < start)
+			return -EFAULT;
+		nr_pages = (start + len - 1) / PAGE_SIZE - start / PAGE_SIZE + 1;
+		max_pages = max(max_pages, nr_pages);
+	}
+	if (!max_pages)
+		return 0;
+
+	if (max_pages > ARRAY_SIZE(pp_stack)) {
+		max_pages = min_t(unsigned long, max_pages, PVM_MAX_PAGES);
+		pages = kmalloc(max_pages * sizeof(struct page *), GFP_KERNEL);
+		if (!pages)
+			return -ENOMEM;
+	} else {
+		max_pages = ARRAY_SIZE(pp_stack);
+	}
+
+	rcu_read_lock();
+	task = find_task_by_vpid(pid);
+	if (task)
+		get_task_struct(task);
+	rcu_read_unlock();
+	if (!task) {
+		rc = -ESRCH;
+		goto free_pages;
+	}
+
+	/* The same permission check as attaching with ptrace */
+	task_lock(task);
+	if (__ptrace_may_access(task, PTRACE_MODE_ATTACH)) {
+		task_unlock(task);
+		rc = -EPERM;
+		goto put_task;
+	}
+	mm = task->mm;
+	if (!mm || (task->flags & PF_KTHREAD)) {
+		task_unlock(task);
+		rc = -EINVAL;
+		goto put_task;
+	}
+	atomic_inc(&mm->mm_users);
+	task_unlock(task);
+
+	for (i = 0; i < riovcnt && it.seg < liovcnt; i++) {
+		rc = process_vm_rw_single_vec(
+			(unsigned long)rvec[i].iov_base, rvec[i].iov_len,
+			pages, max_pages, &it, task, mm, vm_write, &copied);
+		if (rc)
+			break;
+	}
+
+	/* A partial copy is reported like a short read or write */
+	if (copied)
+		rc = copied;
+
+	mmput(mm);
+put_task:
+	put_task_struct(task);
+free_pages:
+	if (pages != pp_stack)
+		kfree(pages);
+	return rc;
+}
+
+static ssize_t process_vm_rw(pid_t pid, const struct iovec __user *lvec,
+			     unsigned long liovcnt,
+			     const struct iovec __user *rvec,
+			     unsigned long riovcnt,
+			     unsigned long flags, int vm_write)
+{
+	struct iovec iovstack_l[UIO_FASTIOV];
+	struct iovec iovstack_r[UIO_FASTIOV];
+	struct iovec *iov_l = iovstack_l;
+	struct iovec *iov_r = iovstack_r;
+	ssize_t rc;
+
+	if (flags != 0)
+		return -EINVAL;
+
+	/* Reading from the remote process writes to the local buffers */
+	rc = rw_copy_check_uvector(vm_write ? WRITE : READ, lvec, liovcnt,
+				   UIO_FASTIOV, iovstack_l, &iov_l, 1);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	/* The remote buffers are checked by get_user_pages() */
+	rc = rw_copy_check_uvector(READ, rvec, riovcnt, UIO_FASTIOV,
+				   iovstack_r, &iov_r, 0);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	rc = process_vm_rw_core(pid, iov_l, liovcnt, iov_r, riovcnt, flags,
+				vm_write);
+
+free_iovecs:
+	if (iov_r != iovstack_r)
+		kfree(iov_r);
+	if (iov_l != iovstack_l)
+		kfree(iov_l);
+	return rc;
+}
+
+SYSCALL_DEFINE6(process_vm_readv, pid_t, pid, const struct iovec __user *, lvec,
+		unsigned long, liovcnt, const struct iovec __user *, rvec,
+		unsigned long, riovcnt,	unsigned long, flags)
+{
+	return process_vm_rw(pid, lvec, liovcnt, rvec, riovcnt, flags, 0);
+}
+
+SYSCALL_DEFINE6(process_vm_writev, pid_t, pid,
+		const struct iovec __user *, lvec,
+		unsigned long, liovcnt, const struct iovec __user *, rvec,
+		unsigned long, riovcnt,	unsigned long, flags)
+{
+	return process_vm_rw(pid, lvec, liovcnt, rvec, riovcnt, flags, 1);
+}
+
+#ifdef CONFIG_COMPAT
+
+static ssize_t
+compat_process_vm_rw(compat_pid_t pid,
+		     const struct compat_iovec __user *lvec,
+		     unsigned long liovcnt,
+		     const struct compat_iovec __user *rvec,
+		     unsigned long riovcnt,
+		     unsigned long flags, int vm_write)
+{
+	struct iovec iovstack_l[UIO_FASTIOV];
+	struct iovec iovstack_r[UIO_FASTIOV];
+	struct iovec *iov_l = iovstack_l;
+	struct iovec *iov_r = iovstack_r;
+	ssize_t rc = -EFAULT;
+
+	if (flags != 0)
+		return -EINVAL;
+
+	if (!access_ok(VERIFY_READ, lvec, liovcnt * sizeof(*lvec)))
+		goto out;
+	if (!access_ok(VERIFY_READ, rvec, riovcnt * sizeof(*rvec)))
+		goto out;
+
+	rc = compat_rw_copy_check_uvector(vm_write ? WRITE : READ, lvec,
+					  liovcnt, UIO_FASTIOV, iovstack_l,
+					  &iov_l, 1);
+	if (rc <= 0)
+		goto free_iovecs;
+	rc = compat_rw_copy_check_uvector(READ, rvec, riovcnt, UIO_FASTIOV,
+					  iovstack_r, &iov_r, 0);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	rc = process_vm_rw_core(pid, iov_l, liovcnt, iov_r, riovcnt, flags,
+				vm_write);
+
+free_iovecs:
+	if (iov_r != iovstack_r)
+		kfree(iov_r);
+	if (iov_l != iovstack_l)
+		kfree(iov_l);
+out:
+	return rc;
+}
+
+asmlinkage ssize_t
+compat_sys_process_vm_readv(compat_pid_t pid,
+			    const struct compat_iovec __user *lvec,
+			    unsigned long liovcnt,
+			    const struct compat_iovec __user *rvec,
+			    unsigned long riovcnt,
+			    unsigned long flags)
+{
+	return compat_process_vm_rw(pid, lvec, liovcnt, rvec,
+				    riovcnt, flags, 0);
+}
+
+asmlinkage ssize_t
+compat_sys_process_vm_writev(compat_pid_t pid,
+			     const struct compat_iovec __user *lvec,
+			     unsigned long liovcnt,
+			     const struct compat_iovec __user *rvec,
+			     unsigned long riovcnt,
+			     unsigned long flags)
+{
+	return compat_process_vm_rw(pid, lvec, liovcnt, rvec,
+				    riovcnt, flags, 1);
+}
+
+#endif
@@ -1284,7 +1284,7 @@ repeat:
 
 	if (swap.val) {
 		/* Look it up and read it in.. */
-		swappage = lookup_swap_cache(swap);
+		swappage = lookup_swap_cache(swap, NULL, 0);
 		if (!swappage) {
 			shmem_swp_unmap(entry);
 			/* here we actually do the io */
@@ -1522,6 +1522,228 @@ static int shmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	return ret | VM_FAULT_LOCKED;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Huge tmpfs pages are not compound pages: an extent of HPAGE_PMD_NR
+ * page cache pages is filled from one pmd aligned, physically contiguous
+ * allocation, split into small pages right away, and mapped with a
+ * single huge pmd in shared mappings placed at a matching alignment.
+ * Everything else (read, write, swap, truncation and hole punching)
+ * keeps dealing with the small pages, and a huge pmd is split by just
+ * clearing it, so a partial truncate or hole punch leaves the rest of
+ * the extent in place to be mapped by ptes.
+ */
+static inline bool shmem_huge_enabled(struct inode *inode)
+{
+	return SHMEM_SB(inode->i_sb)->huge ||
+	       (SHMEM_I(inode)->flags & VM_HUGEPAGE);
+}
+
+static struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, unsigned long idx)
+{
+#ifdef CONFIG_NUMA
+	struct vm_area_struct pvma;
+
+	/* Create a pseudo vma that just contains the policy */
+	pvma.vm_start = 0;
+	pvma.vm_pgoff = idx;
+	pvma.vm_ops = NULL;
+	pvma.vm_policy = mpol_shared_policy_lookup(&info->policy, idx);
+
+	return alloc_pages_vma(gfp, HPAGE_PMD_ORDER, &pvma, 0);
+#else
+	return alloc_pages(gfp, HPAGE_PMD_ORDER);
+#endif
+}
+
+static void shmem_unlock_huge_extent(struct page *page)
+{
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		unlock_page(page + i);
+		page_cache_release(page + i);
+	}
+}
+
+/*
+ * Lock the extent of pages starting at @idx if all of them are uptodate
+ * in the page cache and still physically contiguous from a pmd aligned
+ * pfn. Returns its first page, or NULL with nothing locked.
+ */
+static struct page *shmem_lock_huge_extent(struct address_space *mapping,
+					   unsigned long idx)
+{
+	struct page *head, *page;
+	int i;
+
+	head = find_lock_page(mapping, idx);
+	if (!head)
+		return NULL;
+	if (!PageUptodate(head) ||
+	    (page_to_pfn(head) & (HPAGE_PMD_NR - 1))) {
+		unlock_page(head);
+		page_cache_release(head);
+		return NULL;
+	}
+
+	for (i = 1; i < HPAGE_PMD_NR; i++) {
+		page = find_get_page(mapping, idx + i);
+		if (page == head + i && trylock_page(page)) {
+			if (page->mapping == mapping && PageUptodate(page))
+				continue;
+			unlock_page(page);
+		}
+		if (page)
+			page_cache_release(page);
+		goto undo;
+	}
+	return head;
+
+undo:
+	while (--i >= 0) {
+		unlock_page(head + i);
+		page_cache_release(head + i);
+	}
+	return NULL;
+}
+
+/*
+ * Back the extent starting at @idx, which must not have any page in
+ * the page cache yet, with a fresh huge page. Its pages go through
+ * shmem_getpage() one by one exactly as if shmem_readpage() had been
+ * asked for them, which takes care of the block accounting and of
+ * bringing back whatever of the extent is out on swap. Returns the
+ * first page with the whole extent locked, or NULL.
+ */
+static struct page *shmem_alloc_huge_extent(struct inode *inode,
+					    struct vm_area_struct *vma,
+					    unsigned long idx)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct page *head, *page;
+	gfp_t gfp;
+	int i, j, error = 0;
+
+	if (find_get_pages(mapping, idx, 1, &page)) {
+		pgoff_t next = page->index;
+
+		page_cache_release(page);
+		if (next < idx + HPAGE_PMD_NR)
+			return NULL;
+	}
+
+	gfp = GFP_TRANSHUGE & ~__GFP_COMP;
+	if (!transparent_hugepage_defrag(vma))
+		gfp &= ~__GFP_WAIT;
+	head = shmem_alloc_hugepage(gfp, SHMEM_I(inode), idx);
+	if (!head)
+		return NULL;
+	split_page(head, HPAGE_PMD_ORDER);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page = head + i;
+		error = add_to_page_cache_lru(page, mapping, idx + i,
+					      GFP_KERNEL);
+		if (error)
+			break;
+		error = shmem_getpage(inode, idx + i, &page, SGP_CACHE, NULL);
+		if (error) {
+			i++;
+			break;
+		}
+	}
+	if (!error) {
+		count_vm_event(THP_FILE_ALLOC);
+		return head;
+	}
+
+	/* What has been filled in stays behind as ordinary small pages */
+	for (j = 0; j < HPAGE_PMD_NR; j++) {
+		if (j < i)
+			unlock_page(head + j);
+		page_cache_release(head + j);
+	}
+	return NULL;
+}
+
+static int shmem_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd, unsigned int flags)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	unsigned long idx;
+	struct page *page;
+	int ret, i;
+
+	if (!shmem_huge_enabled(inode))
+		return VM_FAULT_FALLBACK;
+	if (!(vma->vm_flags & VM_SHARED) ||
+	    (vma->vm_flags & (VM_LOCKED | VM_NONLINEAR)))
+		return VM_FAULT_FALLBACK;
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+	idx = linear_page_index(vma, haddr);
+	if (idx & (HPAGE_PMD_NR - 1))
+		return VM_FAULT_FALLBACK;
+	if (idx + HPAGE_PMD_NR >
+	    DIV_ROUND_UP(i_size_read(inode), PAGE_CACHE_SIZE))
+		return VM_FAULT_FALLBACK;
+
+	page = shmem_lock_huge_extent(inode->i_mapping, idx);
+	if (!page)
+		page = shmem_alloc_huge_extent(inode, vma, idx);
+	if (!page) {
+		count_vm_event(THP_FILE_FALLBACK);
+		return VM_FAULT_FALLBACK;
+	}
+
+	/* see do_huge_pmd_file_page() */
+	if (vma->vm_flags & VM_WRITE)
+		for (i = 0; i < HPAGE_PMD_NR; i++)
+			set_page_dirty(page + i);
+
+	ret = do_huge_pmd_file_page(vma, haddr, pmd, page);
+	shmem_unlock_huge_extent(page);
+	if (!ret)
+		count_vm_event(THP_FILE_MAPPED);
+	return ret;
+}
+
+/*
+ * A huge pmd can only map an extent if the file offset and the address
+ * agree modulo the huge page size: place mappings of huge files that
+ * way unless the caller insists on an address.
+ */
+static unsigned long shmem_get_unmapped_area(struct file *file,
+		unsigned long uaddr, unsigned long len, unsigned long pgoff,
+		unsigned long flags)
+{
+	unsigned long addr, offset, inflated_len, inflated_addr;
+
+	addr = current->mm->get_unmapped_area(file, uaddr, len, pgoff, flags);
+	if (IS_ERR_VALUE(addr) || (flags & MAP_FIXED) || addr == uaddr)
+		return addr;
+	if (!(flags & MAP_SHARED) || len < HPAGE_PMD_SIZE ||
+	    !shmem_huge_enabled(file->f_path.dentry->d_inode))
+		return addr;
+
+	offset = (pgoff << PAGE_SHIFT) & ~HPAGE_PMD_MASK;
+	if ((addr & ~HPAGE_PMD_MASK) == offset)
+		return addr;
+
+	inflated_len = len + HPAGE_PMD_SIZE - PAGE_SIZE;
+	if (inflated_len < len)
+		return addr;
+	inflated_addr = current->mm->get_unmapped_area(NULL, 0, inflated_len,
+							0, flags);
+	if (IS_ERR_VALUE(inflated_addr))
+		return addr;
+	return inflated_addr + ((offset - inflated_addr) & ~HPAGE_PMD_MASK);
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 #ifdef CONFIG_NUMA
 static int shmem_set_policy(struct vm_area_struct *vma, struct mempolicy *new)
 {
@@ -1571,6 +1793,12 @@ static int shmem_mmap(struct file *file, struct vm_area_struct *vma)
 	file_accessed(file);
 	vma->vm_ops = &shmem_vm_ops;
 	vma->vm_flags |= VM_CAN_NONLINEAR;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	/* lets the fault path try a huge pmd under "madvise" mode too */
+	if ((vma->vm_flags & VM_SHARED) &&
+	    shmem_huge_enabled(file->f_path.dentry->d_inode))
+		vma->vm_flags |= VM_HUGEPAGE;
+#endif
 	return 0;
 }
 
@@ -1595,7 +1823,7 @@ static struct inode *shmem_get_inode(struct super_block *sb, const struct inode
 		info = SHMEM_I(inode);
 		memset(info, 0, (char *)inode - (char *)info);
 		spin_lock_init(&info->lock);
-		info->flags = flags & VM_NORESERVE;
+		info->flags = flags & (VM_NORESERVE | VM_HUGEPAGE);
 		INIT_LIST_HEAD(&info->swaplist);
 		cache_no_acl(inode);
 
@@ -2250,6 +2478,15 @@ static int shmem_parse_options(char *options, struct shmem_sb_info *sbinfo,
 		} else if (!strcmp(this_char,"mpol")) {
 			if (mpol_parse_str(value, &sbinfo->mpol, 1))
 				goto bad_val;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		} else if (!strcmp(this_char,"huge")) {
+			if (!strcmp(value, "always"))
+				sbinfo->huge = true;
+			else if (!strcmp(value, "never"))
+				sbinfo->huge = false;
+			else
+				goto bad_val;
+#endif
 		} else {
 			printk(KERN_ERR "tmpfs: Bad mount option %s\n",
 			       this_char);
@@ -2296,6 +2533,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 	sbinfo->max_blocks  = config.max_blocks;
 	sbinfo->max_inodes  = config.max_inodes;
 	sbinfo->free_inodes = config.max_inodes - inodes;
+	sbinfo->huge        = config.huge;
 
 	mpol_put(sbinfo->mpol);
 	sbinfo->mpol        = config.mpol;	/* transfers initial ref */
@@ -2319,6 +2557,8 @@ static int shmem_show_options(struct seq_file *seq, struct vfsmount *vfs)
 		seq_printf(seq, ",uid=%u", sbinfo->uid);
 	if (sbinfo->gid != 0)
 		seq_printf(seq, ",gid=%u", sbinfo->gid);
+	if (sbinfo->huge)
+		seq_printf(seq, ",huge=always");
 	shmem_show_mpol(seq, sbinfo->mpol);
 	return 0;
 }
@@ -2458,6 +2698,9 @@ static const struct address_space_operations shmem_aops = {
 
 static const struct file_operations shmem_file_operations = {
 	.mmap		= shmem_mmap,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.get_unmapped_area = shmem_get_unmapped_area,
+#endif
 #ifdef CONFIG_TMPFS
 	.llseek		= generic_file_llseek,
 	.read		= do_sync_read,
@@ -2531,6 +2774,9 @@ static const struct super_operations shmem_ops = {
 
 static const struct vm_operations_struct shmem_vm_ops = {
 	.fault		= shmem_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= shmem_pmd_fault,
+#endif
 #ifdef CONFIG_NUMA
 	.set_policy     = shmem_set_policy,
 	.get_policy     = shmem_get_policy,
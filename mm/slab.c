@@ -3652,6 +3652,62 @@ void *kmem_cache_alloc(struct kmem_cache *cachep, gfp_t flags)
 }
 EXPORT_SYMBOL(kmem_cache_alloc);
 
+/**
+ * kmem_cache_alloc_bulk - Allocate a number of objects
+ * @cachep: The cache to allocate from.
+ * @flags: See kmalloc().
+ * @nr: The number of objects.
+ * @p: Array the objects are stored in.
+ *
+ * Fills @p with @nr objects, taking them from the per cpu array cache
+ * with interrupts disabled only once. Returns @nr, or 0 if not all
+ * objects could be allocated; nothing is left allocated in that case.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *cachep, gfp_t flags, size_t nr,
+			  void **p)
+{
+	unsigned long save_flags;
+	size_t i, j;
+
+	flags &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(flags);
+
+	if (slab_should_failslab(cachep, flags))
+		return 0;
+
+	cache_alloc_debugcheck_before(cachep, flags);
+	local_irq_save(save_flags);
+	for (i = 0; i < nr; i++) {
+		p[i] = __do_cache_alloc(cachep, flags);
+		if (unlikely(!p[i]))
+			break;
+	}
+	local_irq_restore(save_flags);
+
+	for (j = 0; j < i; j++) {
+		void *objp;
+
+		objp = cache_alloc_debugcheck_after(cachep, flags, p[j],
+						    __builtin_return_address(0));
+		kmemleak_alloc_recursive(objp, obj_size(cachep), 1,
+					 cachep->flags, flags);
+		kmemcheck_slab_alloc(cachep, flags, objp, obj_size(cachep));
+		if (unlikely(flags & __GFP_ZERO))
+			memset(objp, 0, obj_size(cachep));
+		trace_kmem_cache_alloc(_RET_IP_, objp, obj_size(cachep),
+				       cachep->buffer_size, flags);
+		p[j] = objp;
+	}
+
+	if (unlikely(i < nr)) {
+		kmem_cache_free_bulk(cachep, i, p);
+		return 0;
+	}
+	return nr;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 #ifdef CONFIG_TRACING
 void *kmem_cache_alloc_notrace(struct kmem_cache *cachep, gfp_t flags)
 {
@@ -3828,6 +3884,36 @@ void kmem_cache_free(struct kmem_cache *cachep, void *objp)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/**
+ * kmem_cache_free_bulk - Deallocate a number of objects.
+ * @cachep: The cache the allocations were from.
+ * @nr: The number of objects.
+ * @p: Array of the objects.
+ *
+ * Like kmem_cache_free() on every object, but interrupts are only
+ * disabled once for the whole batch.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *cachep, size_t nr, void **p)
+{
+	unsigned long flags;
+	size_t i;
+
+	local_irq_save(flags);
+	for (i = 0; i < nr; i++) {
+		void *objp = p[i];
+
+		debug_check_no_locks_freed(objp, obj_size(cachep));
+		if (!(cachep->flags & SLAB_DEBUG_OBJECTS))
+			debug_check_no_obj_freed(objp, obj_size(cachep));
+		__cache_free(cachep, objp);
+	}
+	local_irq_restore(flags);
+
+	for (i = 0; i < nr; i++)
+		trace_kmem_cache_free(_RET_IP_, p[i]);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 /**
  * kfree - free previously allocated memory
  * @objp: pointer returned by kmalloc.
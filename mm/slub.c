@@ -27,6 +27,7 @@
 #include <linux/memory.h>
 #include <linux/math64.h>
 #include <linux/fault-inject.h>
+#include <linux/uaccess.h>
 
 /*
  * Lock order:
@@ -70,12 +71,28 @@
  *   interrupts are disabled to ensure that the processor does not change
  *   while handling per_cpu slabs, due to kernel preemption.
  *
+ *   Where the processor can exchange two words atomically the fastpaths do
+ *   not disable interrupts at all. The per cpu freelist is paired with a
+ *   transaction id that is changed by every operation on the per cpu
+ *   structure, and a single this_cpu_cmpxchg_double() on both words then
+ *   either commits the operation on the right processor or fails and is
+ *   retried. Everything beyond the fastpaths still runs with interrupts
+ *   disabled.
+ *
  * SLUB assigns one slab for allocation to each processor.
  * Allocations only occur from these slabs called cpu slabs.
  *
  * Slabs with free elements are kept on a partial list and during regular
  * operations no list for full slabs is used. If an object in a full slab is
  * freed then the slab will show up again on the partial lists.
+ *
+ * Each processor also keeps a short list of frozen partial slabs
+ * (kmem_cache_cpu->partial), chained through page->next. A full slab that
+ * gets an object freed goes there instead of onto the node partial list,
+ * and the allocation slowpath refills the cpu slab from there before it
+ * looks at the node lists. This keeps list_lock out of most of the slow
+ * paths. Once more than kmem_cache->cpu_partial objects are held this way
+ * the whole per cpu list is moved back to the node partial lists.
  * We track full slabs for debugging purposes though because otherwise we
  * cannot scan all objects.
  *
@@ -168,6 +185,7 @@ static inline int kmem_cache_debug(struct kmem_cache *s)
 
 /* Internal SLUB flags */
 #define __OBJECT_POISON		0x80000000UL /* Poison object */
+#define __CMPXCHG_DOUBLE	0x40000000UL /* Use cmpxchg_double */
 
 static int kmem_size = sizeof(struct kmem_cache);
 
@@ -215,13 +233,106 @@ static inline void sysfs_slab_remove(struct kmem_cache *s)
 
 #endif
 
-static inline void stat(struct kmem_cache *s, enum stat_item si)
+static inline void stat(const struct kmem_cache *s, enum stat_item si)
 {
 #ifdef CONFIG_SLUB_STATS
 	__this_cpu_inc(s->cpu_slab->stat[si]);
 #endif
 }
 
+#ifdef CONFIG_HAVE_CMPXCHG_DOUBLE
+/*
+ * Transaction ids are incremented by TID_STEP on every operation on a
+ * per cpu structure. The low bits hold the cpu number so that a tid read
+ * on one processor can never match the tid of another one.
+ */
+#ifdef CONFIG_PREEMPT
+#define TID_STEP  roundup_pow_of_two(CONFIG_NR_CPUS)
+#else
+/*
+ * No preemption supported therefore also no need to check for
+ * different cpus.
+ */
+#define TID_STEP 1
+#endif
+
+static inline unsigned long next_tid(unsigned long tid)
+{
+	return tid + TID_STEP;
+}
+
+static inline unsigned int tid_to_cpu(unsigned long tid)
+{
+	return tid % TID_STEP;
+}
+
+static inline unsigned long tid_to_event(unsigned long tid)
+{
+	return tid / TID_STEP;
+}
+
+static inline unsigned int init_tid(int cpu)
+{
+	return cpu;
+}
+
+static inline void note_cmpxchg_failure(const char *n,
+		const struct kmem_cache *s, unsigned long tid)
+{
+#ifdef SLUB_DEBUG_CMPXCHG
+	unsigned long actual_tid = __this_cpu_read(s->cpu_slab->tid);
+
+	printk(KERN_INFO "%s %s: cmpxchg redo ", n, s->name);
+
+#ifdef CONFIG_PREEMPT
+	if (tid_to_cpu(tid) != tid_to_cpu(actual_tid))
+		printk("due to cpu change %d -> %d\n",
+			tid_to_cpu(tid), tid_to_cpu(actual_tid));
+	else
+#endif
+	if (tid_to_event(tid) != tid_to_event(actual_tid))
+		printk("due to cpu running other code. Event %ld->%ld\n",
+			tid_to_event(tid), tid_to_event(actual_tid));
+	else
+		printk("for unknown reason: actual=%lx was=%lx target=%lx\n",
+			actual_tid, tid, next_tid(tid));
+#endif
+	stat(s, CMPXCHG_DOUBLE_CPU_FAIL);
+}
+
+/*
+ * Only caches without debugging use the lockless fastpaths, and only if
+ * the processor actually implements the double word cmpxchg.
+ */
+static inline int kmem_cache_has_cmpxchg_double(struct kmem_cache *s)
+{
+	return !kmem_cache_debug(s) && system_has_cmpxchg_double();
+}
+#else
+static inline unsigned long next_tid(unsigned long tid)
+{
+	return tid + 1;
+}
+
+static inline unsigned int init_tid(int cpu)
+{
+	return cpu;
+}
+
+static inline int kmem_cache_has_cmpxchg_double(struct kmem_cache *s)
+{
+	return 0;
+}
+#endif
+
+static void init_kmem_cache_cpus(struct kmem_cache *s)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		per_cpu_ptr(s->cpu_slab, cpu)->tid = init_tid(cpu);
+}
+
 /********************************************************************
  * 			Core slab cache functions
  *******************************************************************/
@@ -259,6 +370,24 @@ static inline void *get_freepointer(struct kmem_cache *s, void *object)
 	return *(void **)(object + s->offset);
 }
 
+/*
+ * The lockless allocation fastpath may read the free pointer of an object
+ * that has already been allocated and freed again (the cmpxchg then fails
+ * and the value is discarded). With DEBUG_PAGEALLOC the slab page might
+ * even have been unmapped by then, so the read must not fault.
+ */
+static inline void *get_freepointer_safe(struct kmem_cache *s, void *object)
+{
+	void *p;
+
+#ifdef CONFIG_DEBUG_PAGEALLOC
+	probe_kernel_read(&p, (void **)(object + s->offset), sizeof(p));
+#else
+	p = get_freepointer(s, object);
+#endif
+	return p;
+}
+
 static inline void set_freepointer(struct kmem_cache *s, void *object, void *fp)
 {
 	*(void **)(object + s->offset) = fp;
@@ -1342,12 +1471,20 @@ static inline int lock_and_freeze_slab(struct kmem_cache_node *n,
 	return 0;
 }
 
+static void put_cpu_partial(struct kmem_cache *s, struct page *page);
+
 /*
  * Try to allocate a partial slab from a specific node.
+ *
+ * The first slab that can be locked is returned locked and frozen. While
+ * the list_lock is held anyway, further slabs are frozen and moved to the
+ * per cpu partial list until it holds about half of s->cpu_partial objects.
  */
-static struct page *get_partial_node(struct kmem_cache_node *n)
+static struct page *get_partial_node(struct kmem_cache *s,
+					struct kmem_cache_node *n)
 {
-	struct page *page;
+	struct page *page, *page2, *first = NULL, *extra = NULL;
+	int available = 0;
 
 	/*
 	 * Racy check. If we mistakenly see no partial slabs then we
@@ -1359,13 +1496,35 @@ static struct page *get_partial_node(struct kmem_cache_node *n)
 		return NULL;
 
 	spin_lock(&n->list_lock);
-	list_for_each_entry(page, &n->partial, lru)
-		if (lock_and_freeze_slab(n, page))
-			goto out;
-	page = NULL;
-out:
+	list_for_each_entry_safe(page, page2, &n->partial, lru) {
+		if (!first) {
+			if (!lock_and_freeze_slab(n, page))
+				continue;
+			first = page;
+			if (!s->cpu_partial)
+				break;
+			continue;
+		}
+
+		if (available > s->cpu_partial / 2)
+			break;
+
+		if (!lock_and_freeze_slab(n, page))
+			continue;
+		available += page->objects - page->inuse;
+		slab_unlock(page);
+		page->next = extra;
+		extra = page;
+	}
 	spin_unlock(&n->list_lock);
-	return page;
+
+	/* Draining the per cpu list may need list_lock, so do it unlocked */
+	while ((page = extra)) {
+		extra = page->next;
+		put_cpu_partial(s, page);
+		stat(s, CPU_PARTIAL_NODE);
+	}
+	return first;
 }
 
 /*
@@ -1411,7 +1570,7 @@ static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
 
 		if (n && cpuset_zone_allowed_hardwall(zone, flags) &&
 				n->nr_partial > s->min_partial) {
-			page = get_partial_node(n);
+			page = get_partial_node(s, n);
 			if (page) {
 				put_mems_allowed();
 				return page;
@@ -1431,7 +1590,7 @@ static struct page *get_partial(struct kmem_cache *s, gfp_t flags, int node)
 	struct page *page;
 	int searchnode = (node == NUMA_NO_NODE) ? numa_node_id() : node;
 
-	page = get_partial_node(get_node(s, searchnode));
+	page = get_partial_node(s, get_node(s, searchnode));
 	if (page || node != -1)
 		return page;
 
@@ -1516,9 +1675,62 @@ static void deactivate_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 		page->inuse--;
 	}
 	c->page = NULL;
+	c->tid = next_tid(c->tid);
 	unfreeze_slab(s, page, tail);
 }
 
+/*
+ * Move all the slabs on the per cpu partial list back to the node
+ * partial lists, freeing the empty ones if the node has enough.
+ *
+ * Interrupts must be disabled.
+ */
+static void unfreeze_partials(struct kmem_cache *s, struct kmem_cache_cpu *c)
+{
+	struct page *page;
+
+	while ((page = c->partial)) {
+		c->partial = page->next;
+		slab_lock(page);
+		unfreeze_slab(s, page, 1);
+	}
+}
+
+/*
+ * Put a slab that was frozen by the caller onto the per cpu partial list.
+ * If the list already holds more than s->cpu_partial objects it is
+ * drained to the node lists first.
+ *
+ * Interrupts must be disabled and the slab lock of the page not held.
+ */
+static void put_cpu_partial(struct kmem_cache *s, struct page *page)
+{
+	struct kmem_cache_cpu *c = __this_cpu_ptr(s->cpu_slab);
+	struct page *oldpage = c->partial;
+	int pages = 0;
+	int pobjects = 0;
+
+	if (oldpage) {
+		pobjects = oldpage->pobjects;
+		pages = oldpage->pages;
+		if (pobjects > s->cpu_partial) {
+			unfreeze_partials(s, c);
+			pobjects = 0;
+			pages = 0;
+			oldpage = NULL;
+			stat(s, CPU_PARTIAL_DRAIN);
+		}
+	}
+
+	pages++;
+	pobjects += page->objects - page->inuse;
+
+	page->pages = pages;
+	page->pobjects = pobjects;
+	page->next = oldpage;
+	c->partial = page;
+}
+
 static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 {
 	stat(s, CPUSLAB_FLUSH);
@@ -1535,8 +1747,11 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
-	if (likely(c && c->page))
-		flush_slab(s, c);
+	if (likely(c)) {
+		if (c->page)
+			flush_slab(s, c);
+		unfreeze_partials(s, c);
+	}
 }
 
 static void flush_cpu_slab(void *d)
@@ -1631,25 +1846,34 @@ slab_out_of_memory(struct kmem_cache *s, gfp_t gfpflags, int nid)
  * Slow path. The lockless freelist is empty or we need to perform
  * debugging duties.
  *
- * Interrupts are disabled.
+ * Interrupts are disabled here if the caller has not done so already: the
+ * lockless fastpath calls us with interrupts enabled and we may have been
+ * moved to another processor since, so the per cpu structure is looked
+ * up again.
  *
  * Processing is still very fast if new objects have been freed to the
  * regular freelist. In that case we simply take over the regular freelist
  * as the lockless freelist and zap the regular freelist.
  *
- * If that is not working then we fall back to the partial lists. We take the
- * first element of the freelist as the object to allocate now and move the
- * rest of the freelist to the lockless freelist.
+ * If that is not working then we fall back to the per cpu partial slabs
+ * and then to the node partial lists. We take the first element of the
+ * freelist as the object to allocate now and move the rest of the freelist
+ * to the lockless freelist.
  *
  * And if we were unable to get a new slab from the partial slab lists then
  * we need to allocate a new slab. This is the slowest path since it involves
  * a call to the page allocator and the setup of a new slab.
  */
 static void *__slab_alloc(struct kmem_cache *s, gfp_t gfpflags, int node,
-			  unsigned long addr, struct kmem_cache_cpu *c)
+			  unsigned long addr)
 {
 	void **object;
 	struct page *new;
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	c = __this_cpu_ptr(s->cpu_slab);
 
 	/* We handle __GFP_ZERO in the caller */
 	gfpflags &= ~__GFP_ZERO;
@@ -1675,7 +1899,9 @@ load_freelist:
 	c->page->freelist = NULL;
 	c->node = page_to_nid(c->page);
 unlock_out:
+	c->tid = next_tid(c->tid);
 	slab_unlock(c->page);
+	local_irq_restore(flags);
 	stat(s, ALLOC_SLOWPATH);
 	return object;
 
@@ -1683,6 +1909,15 @@ another_slab:
 	deactivate_slab(s, c);
 
 new_slab:
+	new = c->partial;
+	if (new && (node == NUMA_NO_NODE || page_to_nid(new) == node)) {
+		c->partial = new->next;
+		c->page = new;
+		slab_lock(new);
+		stat(s, CPU_PARTIAL_ALLOC);
+		goto load_freelist;
+	}
+
 	new = get_partial(s, gfpflags, node);
 	if (new) {
 		c->page = new;
@@ -1709,6 +1944,7 @@ new_slab:
 		c->page = new;
 		goto load_freelist;
 	}
+	local_irq_restore(flags);
 	if (!(gfpflags & __GFP_NOWARN) && printk_ratelimit())
 		slab_out_of_memory(s, gfpflags, node);
 	return NULL;
@@ -1722,39 +1958,105 @@ debug:
 	goto unlock_out;
 }
 
+#ifdef CONFIG_HAVE_CMPXCHG_DOUBLE
 /*
- * Inlined fastpath so that allocation functions (kmalloc, kmem_cache_alloc)
- * have the fastpath folded into their functions. So no function call
- * overhead for requests that can be satisfied on the fastpath.
- *
- * The fastpath works by first checking if the lockless freelist can be used.
- * If not then __slab_alloc is called for slow processing.
- *
- * Otherwise we can simply pick the next object from the lockless free list.
+ * Lockless variant of the allocation fastpath. Neither interrupts nor
+ * preemption are disabled: the freelist and transaction id are sampled
+ * from whatever processor we happen to run on and the object is only
+ * taken if a this_cpu_cmpxchg_double() on the current processor finds
+ * both unchanged. A different processor or any operation on the per cpu
+ * structure in between changes the tid and we simply retry.
  */
-static __always_inline void *slab_alloc(struct kmem_cache *s,
+static __always_inline void *slab_alloc_cmpxchg(struct kmem_cache *s,
 		gfp_t gfpflags, int node, unsigned long addr)
 {
 	void **object;
 	struct kmem_cache_cpu *c;
-	unsigned long flags;
+	unsigned long tid;
 
-	if (slab_pre_alloc_hook(s, gfpflags))
-		return NULL;
+redo:
+	c = __this_cpu_ptr(s->cpu_slab);
+
+	/*
+	 * The tid must be read before the freelist. If an interrupt
+	 * changes the freelist in between, the tid has changed as well.
+	 */
+	tid = c->tid;
+	barrier();
+
+	object = c->freelist;
+	if (unlikely(!object || !node_match(c, node)))
+		return __slab_alloc(s, gfpflags, node, addr);
+
+	/*
+	 * The free pointer of the object may be stale if we lose the race
+	 * below, but then the cmpxchg fails and the value is never used.
+	 */
+	if (unlikely(!this_cpu_cmpxchg_double(
+			s->cpu_slab->freelist, s->cpu_slab->tid,
+			object, tid,
+			get_freepointer_safe(s, object), next_tid(tid)))) {
+		note_cmpxchg_failure("slab_alloc", s, tid);
+		goto redo;
+	}
+	stat(s, ALLOC_FASTPATH);
+	return object;
+}
+#endif
+
+static __always_inline void *slab_alloc_irq(struct kmem_cache *s,
+		gfp_t gfpflags, int node, unsigned long addr)
+{
+	void **object;
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
 
 	local_irq_save(flags);
 	c = __this_cpu_ptr(s->cpu_slab);
 	object = c->freelist;
 	if (unlikely(!object || !node_match(c, node)))
 
-		object = __slab_alloc(s, gfpflags, node, addr, c);
+		object = __slab_alloc(s, gfpflags, node, addr);
 
 	else {
 		c->freelist = get_freepointer(s, object);
+		/*
+		 * The cmpxchg fastpath may be switched on for this cache
+		 * later: a freelist it sampled before must not match again.
+		 */
+		c->tid = next_tid(c->tid);
 		stat(s, ALLOC_FASTPATH);
 	}
 	local_irq_restore(flags);
 
+	return object;
+}
+
+/*
+ * Inlined fastpath so that allocation functions (kmalloc, kmem_cache_alloc)
+ * have the fastpath folded into their functions. So no function call
+ * overhead for requests that can be satisfied on the fastpath.
+ *
+ * The fastpath works by first checking if the lockless freelist can be used.
+ * If not then __slab_alloc is called for slow processing.
+ *
+ * Otherwise we can simply pick the next object from the lockless free list.
+ */
+static __always_inline void *slab_alloc(struct kmem_cache *s,
+		gfp_t gfpflags, int node, unsigned long addr)
+{
+	void **object;
+
+	if (slab_pre_alloc_hook(s, gfpflags))
+		return NULL;
+
+#ifdef CONFIG_HAVE_CMPXCHG_DOUBLE
+	if (s->flags & __CMPXCHG_DOUBLE)
+		object = slab_alloc_cmpxchg(s, gfpflags, node, addr);
+	else
+#endif
+		object = slab_alloc_irq(s, gfpflags, node, addr);
+
 	if (unlikely(gfpflags & __GFP_ZERO) && object)
 		memset(object, 0, s->objsize);
 
@@ -1817,7 +2119,9 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 {
 	void *prior;
 	void **object = (void *)x;
+	unsigned long flags;
 
+	local_irq_save(flags);
 	stat(s, FREE_SLOWPATH);
 	slab_lock(page);
 
@@ -1840,15 +2144,25 @@ checks_ok:
 
 	/*
 	 * Objects left in the slab. If it was not on the partial list before
-	 * then add it.
+	 * then keep it on this processor's partial list if we can, or else
+	 * add it to the node partial list.
 	 */
 	if (unlikely(!prior)) {
+		if (s->cpu_partial) {
+			__SetPageSlubFrozen(page);
+			slab_unlock(page);
+			put_cpu_partial(s, page);
+			local_irq_restore(flags);
+			stat(s, CPU_PARTIAL_FREE);
+			return;
+		}
 		add_partial(get_node(s, page_to_nid(page)), page, 1);
 		stat(s, FREE_ADD_PARTIAL);
 	}
 
 out_unlock:
 	slab_unlock(page);
+	local_irq_restore(flags);
 	return;
 
 slab_empty:
@@ -1860,6 +2174,7 @@ slab_empty:
 		stat(s, FREE_REMOVE_PARTIAL);
 	}
 	slab_unlock(page);
+	local_irq_restore(flags);
 	stat(s, FREE_SLAB);
 	discard_slab(s, page);
 	return;
@@ -1881,14 +2196,57 @@ debug:
  * If fastpath is not possible then fall back to __slab_free where we deal
  * with all sorts of special processing.
  */
-static __always_inline void slab_free(struct kmem_cache *s,
+#ifdef CONFIG_HAVE_CMPXCHG_DOUBLE
+/*
+ * Lockless variant of the free fastpath, see slab_alloc_cmpxchg().
+ */
+static __always_inline void slab_free_cmpxchg(struct kmem_cache *s,
 			struct page *page, void *x, unsigned long addr)
 {
 	void **object = (void *)x;
 	struct kmem_cache_cpu *c;
+	unsigned long tid;
+#if defined(CONFIG_KMEMCHECK) || defined(CONFIG_LOCKDEP)
 	unsigned long flags;
 
-	slab_free_hook(s, x);
+	/* The debug hooks expect interrupts to be disabled */
+	local_irq_save(flags);
+	slab_free_hook_irq(s, x);
+	local_irq_restore(flags);
+#else
+	slab_free_hook_irq(s, x);
+#endif
+
+redo:
+	c = __this_cpu_ptr(s->cpu_slab);
+
+	tid = c->tid;
+	barrier();
+
+	if (unlikely(page != c->page || c->node == NUMA_NO_NODE)) {
+		__slab_free(s, page, x, addr);
+		return;
+	}
+
+	set_freepointer(s, object, c->freelist);
+
+	if (unlikely(!this_cpu_cmpxchg_double(
+			s->cpu_slab->freelist, s->cpu_slab->tid,
+			c->freelist, tid,
+			object, next_tid(tid)))) {
+		note_cmpxchg_failure("slab_free", s, tid);
+		goto redo;
+	}
+	stat(s, FREE_FASTPATH);
+}
+#endif
+
+static __always_inline void slab_free_irq(struct kmem_cache *s,
+			struct page *page, void *x, unsigned long addr)
+{
+	void **object = (void *)x;
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
 
 	local_irq_save(flags);
 	c = __this_cpu_ptr(s->cpu_slab);
@@ -1898,6 +2256,7 @@ static __always_inline void slab_free(struct kmem_cache *s,
 	if (likely(page == c->page && c->node != NUMA_NO_NODE)) {
 		set_freepointer(s, object, c->freelist);
 		c->freelist = object;
+		c->tid = next_tid(c->tid);
 		stat(s, FREE_FASTPATH);
 	} else
 		__slab_free(s, page, x, addr);
@@ -1905,6 +2264,19 @@ static __always_inline void slab_free(struct kmem_cache *s,
 	local_irq_restore(flags);
 }
 
+static __always_inline void slab_free(struct kmem_cache *s,
+			struct page *page, void *x, unsigned long addr)
+{
+	slab_free_hook(s, x);
+
+#ifdef CONFIG_HAVE_CMPXCHG_DOUBLE
+	if (s->flags & __CMPXCHG_DOUBLE)
+		slab_free_cmpxchg(s, page, x, addr);
+	else
+#endif
+		slab_free_irq(s, page, x, addr);
+}
+
 void kmem_cache_free(struct kmem_cache *s, void *x)
 {
 	struct page *page;
@@ -1917,6 +2289,96 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/*
+ * Free a batch of objects with interrupts disabled only once. Objects of
+ * the current cpu slab go straight onto the per cpu freelist, all others
+ * take the usual slow path.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t nr, void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	size_t i;
+
+	local_irq_save(flags);
+	c = __this_cpu_ptr(s->cpu_slab);
+	for (i = 0; i < nr; i++) {
+		void **object = p[i];
+		struct page *page = virt_to_head_page(object);
+
+		slab_free_hook(s, object);
+		slab_free_hook_irq(s, object);
+
+		if (likely(page == c->page && c->node != NUMA_NO_NODE)) {
+			set_freepointer(s, object, c->freelist);
+			c->freelist = object;
+			stat(s, FREE_FASTPATH);
+		} else
+			__slab_free(s, page, object, _RET_IP_);
+	}
+	/* Make concurrent lockless fastpaths on this cpu retry */
+	c->tid = next_tid(c->tid);
+	local_irq_restore(flags);
+
+	for (i = 0; i < nr; i++)
+		trace_kmem_cache_free(_RET_IP_, p[i]);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+/*
+ * Allocate nr objects into p with interrupts disabled only once, taking
+ * them from the per cpu freelist and refilling it through the slow path
+ * when it runs empty. Either all nr objects are allocated or none.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t nr,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long irqflags;
+	size_t i, j;
+
+	if (slab_pre_alloc_hook(s, flags))
+		return 0;
+
+	local_irq_save(irqflags);
+	c = __this_cpu_ptr(s->cpu_slab);
+	for (i = 0; i < nr; i++) {
+		void **object = c->freelist;
+
+		if (unlikely(!object)) {
+			/*
+			 * __slab_alloc() may enable interrupts to allocate
+			 * a new slab, so we may be on another cpu after it.
+			 */
+			p[i] = __slab_alloc(s, flags, NUMA_NO_NODE, _RET_IP_);
+			c = __this_cpu_ptr(s->cpu_slab);
+			if (unlikely(!p[i]))
+				break;
+			continue;
+		}
+		c->freelist = get_freepointer(s, object);
+		p[i] = object;
+		stat(s, ALLOC_FASTPATH);
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_restore(irqflags);
+
+	for (j = 0; j < i; j++) {
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[j], 0, s->objsize);
+		slab_post_alloc_hook(s, flags, p[j]);
+		trace_kmem_cache_alloc(_RET_IP_, p[j], s->objsize, s->size,
+				       flags);
+	}
+
+	if (unlikely(i < nr)) {
+		kmem_cache_free_bulk(s, i, p);
+		return 0;
+	}
+	return nr;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 /* Figure out on which slab page the object resides */
 static struct page *get_object_page(const void *x)
 {
@@ -2105,9 +2567,19 @@ static inline int alloc_kmem_cache_cpus(struct kmem_cache *s)
 	BUILD_BUG_ON(PERCPU_DYNAMIC_EARLY_SIZE <
 			SLUB_PAGE_SHIFT * sizeof(struct kmem_cache_cpu));
 
-	s->cpu_slab = alloc_percpu(struct kmem_cache_cpu);
+	/*
+	 * freelist and tid must be double word aligned for
+	 * this_cpu_cmpxchg_double() to work on them.
+	 */
+	s->cpu_slab = __alloc_percpu(sizeof(struct kmem_cache_cpu),
+				     2 * sizeof(void *));
+
+	if (!s->cpu_slab)
+		return 0;
+
+	init_kmem_cache_cpus(s);
 
-	return s->cpu_slab != NULL;
+	return 1;
 }
 
 static struct kmem_cache *kmem_cache_node;
@@ -2209,6 +2681,34 @@ static void set_min_partial(struct kmem_cache *s, unsigned long min)
 	s->min_partial = min;
 }
 
+/*
+ * Pick the fastpath flavour and the size of the per cpu partial lists.
+ * Debug caches need every operation to go through the slow paths where
+ * the checks are done, so they use neither.
+ */
+static void set_cpu_slab_mode(struct kmem_cache *s)
+{
+	if (kmem_cache_has_cmpxchg_double(s))
+		s->flags |= __CMPXCHG_DOUBLE;
+	else
+		s->flags &= ~__CMPXCHG_DOUBLE;
+
+	/*
+	 * The number of objects kept on the per cpu partial lists. Large
+	 * objects come in few per slab, so keep fewer of them around.
+	 */
+	if (kmem_cache_debug(s))
+		s->cpu_partial = 0;
+	else if (s->size >= PAGE_SIZE)
+		s->cpu_partial = 2;
+	else if (s->size >= 1024)
+		s->cpu_partial = 6;
+	else if (s->size >= 256)
+		s->cpu_partial = 13;
+	else
+		s->cpu_partial = 30;
+}
+
 /*
  * calculate_sizes() determines the order and the distribution of data within
  * a slab object.
@@ -2365,6 +2865,7 @@ static int kmem_cache_open(struct kmem_cache *s,
 	 * list to avoid pounding the page allocator excessively.
 	 */
 	set_min_partial(s, ilog2(s->size));
+	set_cpu_slab_mode(s);
 	s->refcount = 1;
 #ifdef CONFIG_NUMA
 	s->remote_node_defrag_ratio = 1000;
@@ -3968,6 +4469,29 @@ static ssize_t min_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(min_partial);
 
+static ssize_t cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%u\n", s->cpu_partial);
+}
+
+static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
+				 size_t length)
+{
+	unsigned long objects;
+	int err;
+
+	err = strict_strtoul(buf, 10, &objects);
+	if (err)
+		return err;
+	if (objects && kmem_cache_debug(s))
+		return -EINVAL;
+
+	s->cpu_partial = objects;
+	flush_all(s);
+	return length;
+}
+SLAB_ATTR(cpu_partial);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (s->ctor) {
@@ -3997,6 +4521,37 @@ static ssize_t cpu_slabs_show(struct kmem_cache *s, char *buf)
 }
 SLAB_ATTR_RO(cpu_slabs);
 
+static ssize_t slabs_cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	int objects = 0;
+	int pages = 0;
+	int cpu;
+	int len;
+
+	for_each_online_cpu(cpu) {
+		struct page *page = per_cpu_ptr(s->cpu_slab, cpu)->partial;
+
+		if (page) {
+			pages += page->pages;
+			objects += page->pobjects;
+		}
+	}
+
+	len = sprintf(buf, "%d(%d)", objects, pages);
+
+#ifdef CONFIG_SMP
+	for_each_online_cpu(cpu) {
+		struct page *page = per_cpu_ptr(s->cpu_slab, cpu)->partial;
+
+		if (page && len < PAGE_SIZE - 20)
+			len += sprintf(buf + len, " C%d=%d(%d)", cpu,
+				page->pobjects, page->pages);
+	}
+#endif
+	return len + sprintf(buf + len, "\n");
+}
+SLAB_ATTR_RO(slabs_cpu_partial);
+
 static ssize_t objects_show(struct kmem_cache *s, char *buf)
 {
 	return show_slab_objects(s, buf, SO_ALL|SO_OBJECTS);
@@ -4066,8 +4621,11 @@ static ssize_t sanity_checks_store(struct kmem_cache *s,
 				const char *buf, size_t length)
 {
 	s->flags &= ~SLAB_DEBUG_FREE;
-	if (buf[0] == '1')
+	if (buf[0] == '1') {
 		s->flags |= SLAB_DEBUG_FREE;
+		set_cpu_slab_mode(s);
+		flush_all(s);
+	}
 	return length;
 }
 SLAB_ATTR(sanity_checks);
@@ -4081,8 +4639,11 @@ static ssize_t trace_store(struct kmem_cache *s, const char *buf,
 							size_t length)
 {
 	s->flags &= ~SLAB_TRACE;
-	if (buf[0] == '1')
+	if (buf[0] == '1') {
 		s->flags |= SLAB_TRACE;
+		set_cpu_slab_mode(s);
+		flush_all(s);
+	}
 	return length;
 }
 SLAB_ATTR(trace);
@@ -4102,6 +4663,7 @@ static ssize_t red_zone_store(struct kmem_cache *s,
 	if (buf[0] == '1')
 		s->flags |= SLAB_RED_ZONE;
 	calculate_sizes(s, -1);
+	set_cpu_slab_mode(s);
 	return length;
 }
 SLAB_ATTR(red_zone);
@@ -4121,6 +4683,7 @@ static ssize_t poison_store(struct kmem_cache *s,
 	if (buf[0] == '1')
 		s->flags |= SLAB_POISON;
 	calculate_sizes(s, -1);
+	set_cpu_slab_mode(s);
 	return length;
 }
 SLAB_ATTR(poison);
@@ -4140,6 +4703,7 @@ static ssize_t store_user_store(struct kmem_cache *s,
 	if (buf[0] == '1')
 		s->flags |= SLAB_STORE_USER;
 	calculate_sizes(s, -1);
+	set_cpu_slab_mode(s);
 	return length;
 }
 SLAB_ATTR(store_user);
@@ -4311,6 +4875,11 @@ STAT_ATTR(DEACTIVATE_TO_HEAD, deactivate_to_head);
 STAT_ATTR(DEACTIVATE_TO_TAIL, deactivate_to_tail);
 STAT_ATTR(DEACTIVATE_REMOTE_FREES, deactivate_remote_frees);
 STAT_ATTR(ORDER_FALLBACK, order_fallback);
+STAT_ATTR(CMPXCHG_DOUBLE_CPU_FAIL, cmpxchg_double_cpu_fail);
+STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
+STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
+STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
+STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -4319,10 +4888,12 @@ static struct attribute *slab_attrs[] = {
 	&objs_per_slab_attr.attr,
 	&order_attr.attr,
 	&min_partial_attr.attr,
+	&cpu_partial_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
 	&cpu_slabs_attr.attr,
+	&slabs_cpu_partial_attr.attr,
 	&ctor_attr.attr,
 	&aliases_attr.attr,
 	&align_attr.attr,
@@ -4367,6 +4938,11 @@ static struct attribute *slab_attrs[] = {
 	&deactivate_to_tail_attr.attr,
 	&deactivate_remote_frees_attr.attr,
 	&order_fallback_attr.attr,
+	&cmpxchg_double_cpu_fail_attr.attr,
+	&cpu_partial_alloc_attr.attr,
+	&cpu_partial_free_attr.attr,
+	&cpu_partial_node_attr.attr,
+	&cpu_partial_drain_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
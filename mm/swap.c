@@ -39,6 +39,7 @@ int page_cluster;
 
 static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
+static DEFINE_PER_CPU(struct pagevec, lru_lazyfree_pvecs);
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -56,18 +57,29 @@ static void __page_cache_release(struct page *page)
 		del_page_from_lru(zone, page);
 		spin_unlock_irqrestore(&zone->lru_lock, flags);
 	}
+}
+
+static void __put_single_page(struct page *page)
+{
+	__page_cache_release(page);
 	free_hot_cold_page(page, 0);
 }
 
+static void __put_compound_page(struct page *page)
+{
+	compound_page_dtor *dtor;
+
+	/* transparent huge pages live on the LRU like any other page */
+	__page_cache_release(page);
+	dtor = get_compound_page_dtor(page);
+	(*dtor)(page);
+}
+
 static void put_compound_page(struct page *page)
 {
 	page = compound_head(page);
-	if (put_page_testzero(page)) {
-		compound_page_dtor *dtor;
-
-		dtor = get_compound_page_dtor(page);
-		(*dtor)(page);
-	}
+	if (put_page_testzero(page))
+		__put_compound_page(page);
 }
 
 void put_page(struct page *page)
@@ -75,7 +87,7 @@ void put_page(struct page *page)
 	if (unlikely(PageCompound(page)))
 		put_compound_page(page);
 	else if (put_page_testzero(page))
-		__page_cache_release(page);
+		__put_single_page(page);
 }
 EXPORT_SYMBOL(put_page);
 
@@ -120,7 +132,8 @@ static void pagevec_move_tail(struct pagevec *pvec)
 		}
 		if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
 			int lru = page_lru_base_type(page);
-			list_move_tail(&page->lru, &zone->lru[lru].list);
+			list_move_tail(&page->lru,
+				       zone_lru_evict_list(zone, lru));
 			pgmoved++;
 		}
 	}
@@ -195,6 +208,71 @@ void activate_page(struct page *page)
 	spin_unlock_irq(&zone->lru_lock);
 }
 
+static inline int page_can_lazyfree(struct page *page)
+{
+	return PageLRU(page) && PageAnon(page) && PageSwapBacked(page) &&
+		!PageSwapCache(page) && !PageUnevictable(page);
+}
+
+/*
+ * Move MADV_FREE pages to the inactive file list. Clearing PageSwapBacked
+ * makes reclaim drop them instead of swapping them out, and putting them
+ * on the file list gets them reclaimed even when there is no swap at all.
+ */
+static void pagevec_lazyfree(struct pagevec *pvec)
+{
+	int i;
+	int pgmoved = 0;
+	struct zone *zone = NULL;
+
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+		struct zone *pagezone = page_zone(page);
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irq(&zone->lru_lock);
+			zone = pagezone;
+			spin_lock_irq(&zone->lru_lock);
+		}
+		if (page_can_lazyfree(page)) {
+			int lru = page_lru_base_type(page);
+
+			del_page_from_lru_list(zone, page,
+					       lru + !!PageActive(page));
+			ClearPageActive(page);
+			ClearPageReferenced(page);
+			ClearPageSwapBacked(page);
+			add_page_to_lru_list(zone, page, LRU_INACTIVE_FILE);
+			pgmoved++;
+		}
+	}
+	if (zone)
+		spin_unlock_irq(&zone->lru_lock);
+	count_vm_events(PGLAZYFREE, pgmoved);
+	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	pagevec_reinit(pvec);
+}
+
+/**
+ * mark_page_lazyfree - make an anonymous page freeable without swap-out
+ * @page: page to mark
+ *
+ * The caller must have cleaned the pte mapping the page, so that a later
+ * write by the process can be told apart in try_to_unmap_one().
+ */
+void mark_page_lazyfree(struct page *page)
+{
+	if (page_can_lazyfree(page)) {
+		struct pagevec *pvec = &get_cpu_var(lru_lazyfree_pvecs);
+
+		page_cache_get(page);
+		if (!pagevec_add(pvec, page))
+			pagevec_lazyfree(pvec);
+		put_cpu_var(lru_lazyfree_pvecs);
+	}
+}
+
 /*
  * Mark a page as having seen activity.
  *
@@ -292,6 +370,10 @@ static void drain_cpu_pagevecs(int cpu)
 		pagevec_move_tail(pvec);
 		local_irq_restore(flags);
 	}
+
+	pvec = &per_cpu(lru_lazyfree_pvecs, cpu);
+	if (pagevec_count(pvec))
+		pagevec_lazyfree(pvec);
 }
 
 void lru_add_drain(void)
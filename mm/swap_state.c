@@ -251,37 +251,82 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
 	}
 }
 
+/*
+ * Per-vma readahead state, packed into vma->swap_readahead_info: the
+ * page-aligned address of the last swap fault in the vma, the readahead
+ * window used for it and the number of readahead hits since.
+ */
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) |	\
+	 ((hits) & SWAP_RA_HITS_MASK))
+
+/* Upper bound of the vma readahead window, also limited by page_cluster */
+#define SWAP_RA_ORDER_CEILING	5
+
+int sysctl_swap_vma_readahead __read_mostly = 1;
+
+static void swap_ra_add_hit(struct vm_area_struct *vma)
+{
+	unsigned long ra_val = atomic_long_read(&vma->swap_readahead_info);
+
+	/* Racing updates may lose a hit, it is only a heuristic */
+	if (SWAP_RA_HITS(ra_val) < SWAP_RA_HITS_MAX)
+		atomic_long_set(&vma->swap_readahead_info, ra_val + 1);
+}
+
 /*
  * Lookup a swap entry in the swap cache. A found page will be returned
  * unlocked and with its refcount incremented - we rely on the kernel
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
+ *
+ * A page that was brought in by readahead counts as a readahead hit, for
+ * @vma if it is not NULL.
  */
-struct page * lookup_swap_cache(swp_entry_t entry)
+struct page *lookup_swap_cache(swp_entry_t entry, struct vm_area_struct *vma,
+			       unsigned long addr)
 {
 	struct page *page;
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		/* PG_readahead doubles as PG_reclaim during writeback */
+		if (!PageWriteback(page) && TestClearPageReadahead(page)) {
+			count_vm_event(SWAP_RA_HIT);
+			if (vma)
+				swap_ra_add_hit(vma);
+		}
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
 }
 
-/* 
+/*
  * Locate a page of swap in physical memory, reserving swap cache space
- * and reading the disk if it is not already cached.
- * A failure return means that either the page allocation failed or that
- * the swap entry is no longer in use.
+ * and reading the disk if it is not already cached. *@new_page_read
+ * tells whether a read was started for it.
  */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			int *new_page_read)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
 
+	*new_page_read = 0;
 	do {
 		/*
 		 * First check the swap cache.  Since this is normally
@@ -332,6 +377,7 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			 */
 			lru_cache_add_anon(new_page);
 			swap_readpage(new_page);
+			*new_page_read = 1;
 			return new_page;
 		}
 		radix_tree_preload_end();
@@ -349,6 +395,46 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+/* 
+ * Locate a page of swap in physical memory, reserving swap cache space
+ * and reading the disk if it is not already cached.
+ * A failure return means that either the page allocation failed or that
+ * the swap entry is no longer in use.
+ */
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	int new_page_read;
+
+	return __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &new_page_read);
+}
+
+/*
+ * Start reading @entry as part of a readahead batch. Pages read on
+ * behalf of another fault than the current one (@ahead) are marked so
+ * that lookup_swap_cache() can account hits on them. Returns 0 when the
+ * page could not be found or allocated.
+ */
+static int swap_readahead_one(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			int ahead)
+{
+	struct page *page;
+	int new_page_read;
+
+	page = __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &new_page_read);
+	if (!page)
+		return 0;
+	if (ahead && new_page_read) {
+		SetPageReadahead(page);
+		count_vm_event(SWAP_RA);
+	}
+	page_cache_release(page);
+	return 1;
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -372,7 +458,6 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 			struct vm_area_struct *vma, unsigned long addr)
 {
 	int nr_pages;
-	struct page *page;
 	unsigned long offset;
 	unsigned long end_offset;
 
@@ -386,12 +471,128 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	nr_pages = valid_swaphandles(entry, &offset);
 	for (end_offset = offset + nr_pages; offset < end_offset; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
-		if (!page)
+		if (!swap_readahead_one(swp_entry(swp_type(entry), offset),
+					gfp_mask, vma, addr,
+					offset != swp_offset(entry)))
 			break;
-		page_cache_release(page);
 	}
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
+
+/*
+ * Size of the next readahead window: grow with the hits the last window
+ * got, shrink no faster than by half per fault, and with no hits at all
+ * only read ahead while the faults are sequential.
+ */
+static unsigned int swap_ra_window(unsigned long prev_pfn, unsigned long pfn,
+				   unsigned int hits, unsigned int max_win,
+				   unsigned int prev_win)
+{
+	unsigned int win = hits + 2;
+
+	if (win == 2) {
+		if (pfn != prev_pfn + 1 && pfn != prev_pfn - 1)
+			win = 1;
+	} else
+		win = roundup_pow_of_two(win);
+
+	if (win > max_win)
+		win = max_win;
+	if (win < prev_win / 2)
+		win = prev_win / 2;
+	return win;
+}
+
+/**
+ * swapin_vma_readahead - swap in pages around a fault in virtual order
+ * @fentry: swap entry of the faulting pte
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma the fault is in
+ * @faddr: faulting address
+ * @pmd: pmd mapping the faulting pte
+ *
+ * Once a process has been swapped in and out a few times, the order of
+ * its pages in the swap area has little to do with their virtual order,
+ * so instead of the neighbouring swap slots read the swap entries of the
+ * neighbouring ptes. The window is sized by how many pages the previous
+ * window around a fault in this vma got used, and placed ahead of or
+ * behind the fault when the faults walk through the vma in order.
+ *
+ * Falls back to swapin_readahead() when disabled by the
+ * vm.swap_vma_readahead sysctl.
+ *
+ * Caller must hold down_read on the vma->vm_mm.
+ */
+struct page *swapin_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
+				  struct vm_area_struct *vma,
+				  unsigned long faddr, pmd_t *pmd)
+{
+	pte_t ptes[1 << SWAP_RA_ORDER_CEILING];
+	unsigned long ra_val, prev_pfn, fpfn, lpfn, start, end, addr;
+	unsigned int max_win, win, left;
+	int cluster;
+	pte_t *pte;
+	int i, nr;
+
+	if (!sysctl_swap_vma_readahead)
+		return swapin_readahead(fentry, gfp_mask, vma, faddr);
+
+	cluster = ACCESS_ONCE(page_cluster);
+	max_win = 1 << clamp(cluster, 0, SWAP_RA_ORDER_CEILING);
+
+	faddr &= PAGE_MASK;
+	fpfn = faddr >> PAGE_SHIFT;
+	ra_val = atomic_long_read(&vma->swap_readahead_info);
+	prev_pfn = SWAP_RA_ADDR(ra_val) >> PAGE_SHIFT;
+	win = swap_ra_window(prev_pfn, fpfn, SWAP_RA_HITS(ra_val),
+			     max_win, SWAP_RA_WIN(ra_val));
+	atomic_long_set(&vma->swap_readahead_info,
+			SWAP_RA_VAL(faddr, win, 0));
+	if (win == 1)
+		goto skip;
+
+	/* Read ahead in the direction the faults are moving in */
+	if (fpfn == prev_pfn + 1)
+		left = 0;
+	else if (fpfn == prev_pfn - 1)
+		left = win - 1;
+	else
+		left = (win - 1) / 2;
+	lpfn = fpfn > left ? fpfn - left : 0;
+
+	/* Stay within the vma and the page table of the fault */
+	start = max3(lpfn, vma->vm_start >> PAGE_SHIFT,
+		     (faddr & PMD_MASK) >> PAGE_SHIFT);
+	end = min3(lpfn + win, vma->vm_end >> PAGE_SHIFT,
+		   ((faddr & PMD_MASK) + PMD_SIZE) >> PAGE_SHIFT);
+
+	/*
+	 * mmap_sem keeps the page table around, but the ptes may change
+	 * under us: they are only a hint, the swap cache sorts out stale
+	 * entries.
+	 */
+	nr = end - start;
+	pte = pte_offset_map(pmd, start << PAGE_SHIFT);
+	for (i = 0; i < nr; i++)
+		ptes[i] = pte[i];
+	pte_unmap(pte);
+
+	for (i = 0, addr = start << PAGE_SHIFT; i < nr;
+	     i++, addr += PAGE_SIZE) {
+		swp_entry_t entry;
+
+		if (pte_none(ptes[i]) || pte_present(ptes[i]) ||
+		    pte_file(ptes[i]))
+			continue;
+		entry = pte_to_swp_entry(ptes[i]);
+		if (unlikely(non_swap_entry(entry)))
+			continue;
+		if (!swap_readahead_one(entry, gfp_mask, vma, addr,
+					addr != faddr))
+			break;
+	}
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+skip:
+	return read_swap_cache_async(fentry, gfp_mask, vma, faddr);
+}
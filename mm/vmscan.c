@@ -703,6 +703,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		struct address_space *mapping;
 		struct page *page;
 		int may_enter_fs;
+		int lazyfree;
 
 		cond_resched();
 
@@ -759,13 +760,23 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			; /* try to reclaim the page below */
 		}
 
+		/*
+		 * Anonymous memory released with MADV_FREE needs no backing
+		 * store: if it was not written to since, it is simply dropped.
+		 */
+		lazyfree = PageAnon(page) && !PageSwapBacked(page);
+
 		/*
 		 * Anonymous process memory has backing store?
 		 * Try to allocate it some swap space here.
 		 */
-		if (PageAnon(page) && !PageSwapCache(page)) {
+		if (PageAnon(page) && !PageSwapCache(page) && !lazyfree) {
 			if (!(sc->gfp_mask & __GFP_IO))
 				goto keep_locked;
+			/* swap works on small pages only */
+			if (unlikely(PageTransHuge(page)) &&
+			    unlikely(split_huge_page(page)))
+				goto activate_locked;
 			if (!add_to_swap(page))
 				goto activate_locked;
 			may_enter_fs = 1;
@@ -777,7 +788,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		 * The page is mapped into the page tables of one or more
 		 * processes. Try to unmap it here.
 		 */
-		if (page_mapped(page) && mapping) {
+		if (page_mapped(page) && (mapping || lazyfree)) {
 			switch (try_to_unmap(page, TTU_UNMAP)) {
 			case SWAP_FAIL:
 				goto activate_locked;
@@ -790,6 +801,21 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
+		if (lazyfree) {
+			if (PageDirty(page))
+				goto activate_locked;
+			/* Same as __remove_mapping(), minus the mapping */
+			if (!page_freeze_refs(page, 1))
+				goto keep_locked;
+			if (unlikely(PageDirty(page))) {
+				page_unfreeze_refs(page, 1);
+				goto keep_locked;
+			}
+			count_vm_event(PGLAZYFREED);
+			__clear_page_locked(page);
+			goto free_it;
+		}
+
 		if (PageDirty(page)) {
 			nr_dirty++;
 
@@ -902,6 +928,9 @@ activate_locked:
 		/* Not a candidate for swapping, so reclaim swap space. */
 		if (PageSwapCache(page) && vm_swap_full())
 			try_to_free_swap(page);
+		/* A MADV_FREE page written to again is a normal anon page */
+		if (PageAnon(page) && !PageSwapBacked(page) && PageDirty(page))
+			SetPageSwapBacked(page);
 		VM_BUG_ON(PageActive(page));
 		SetPageActive(page);
 		pgactivate++;
@@ -1028,7 +1057,7 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 		case 0:
 			list_move(&page->lru, dst);
 			mem_cgroup_del_lru(page);
-			nr_taken++;
+			nr_taken += hpage_nr_pages(page);
 			break;
 
 		case -EBUSY:
@@ -1086,7 +1115,7 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 			if (__isolate_lru_page(cursor_page, mode, file) == 0) {
 				list_move(&cursor_page->lru, dst);
 				mem_cgroup_del_lru(cursor_page);
-				nr_taken++;
+				nr_taken += hpage_nr_pages(cursor_page);
 				nr_lumpy_taken++;
 				if (PageDirty(cursor_page))
 					nr_lumpy_dirty++;
@@ -1129,6 +1158,33 @@ static unsigned long isolate_pages_global(unsigned long nr,
 								mode, file);
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Take pages off the oldest generation of the given type. Its pages are
+ * active or not depending on how they got there, take both: the active
+ * flags are cleared like for lumpy reclaim.
+ */
+static unsigned long lru_gen_isolate_pages(unsigned long nr,
+					   struct list_head *dst,
+					   unsigned long *scanned, int order,
+					   struct zone *z, int file)
+{
+	lru_gen_update_min_seq(z, file);
+	return isolate_lru_pages(nr, zone_lru_evict_list(z, LRU_FILE * file),
+				 dst, scanned, order, ISOLATE_BOTH, file);
+}
+#else
+static inline unsigned long lru_gen_isolate_pages(unsigned long nr,
+						  struct list_head *dst,
+						  unsigned long *scanned,
+						  int order, struct zone *z,
+						  int file)
+{
+	BUG();
+	return 0;
+}
+#endif
+
 /*
  * clear_active_flags() is a helper for shrink_active_list(), clearing
  * any active bits from the pages in the list.
@@ -1141,14 +1197,15 @@ static unsigned long clear_active_flags(struct list_head *page_list,
 	struct page *page;
 
 	list_for_each_entry(page, page_list, lru) {
+		int numpages = hpage_nr_pages(page);
 		lru = page_lru_base_type(page);
 		if (PageActive(page)) {
 			lru += LRU_ACTIVE;
 			ClearPageActive(page);
-			nr_active++;
+			nr_active += numpages;
 		}
 		if (count)
-			count[lru]++;
+			count[lru] += numpages;
 	}
 
 	return nr_active;
@@ -1373,11 +1430,16 @@ shrink_inactive_list(unsigned long nr_to_scan, struct zone *zone,
 	spin_lock_irq(&zone->lru_lock);
 
 	if (scanning_global_lru(sc)) {
-		nr_taken = isolate_pages_global(nr_to_scan,
-			&page_list, &nr_scanned, sc->order,
-			sc->lumpy_reclaim_mode == LUMPY_MODE_NONE ?
+		if (lru_gen_zone_enabled(zone))
+			nr_taken = lru_gen_isolate_pages(nr_to_scan,
+				&page_list, &nr_scanned, sc->order,
+				zone, file);
+		else
+			nr_taken = isolate_pages_global(nr_to_scan,
+				&page_list, &nr_scanned, sc->order,
+				sc->lumpy_reclaim_mode == LUMPY_MODE_NONE ?
 					ISOLATE_INACTIVE : ISOLATE_BOTH,
-			zone, 0, file);
+				zone, 0, file);
 		zone->pages_scanned += nr_scanned;
 		if (current_is_kswapd())
 			__count_zone_vm_events(PGSCAN_KSWAPD, zone,
@@ -1464,9 +1526,9 @@ static void move_active_pages_to_lru(struct zone *zone,
 		VM_BUG_ON(PageLRU(page));
 		SetPageLRU(page);
 
-		list_move(&page->lru, &zone->lru[lru].list);
+		list_move(&page->lru, zone_lru_list(zone, lru));
 		mem_cgroup_add_lru_list(page, lru);
-		pgmoved++;
+		pgmoved += hpage_nr_pages(page);
 
 		if (!pagevec_add(&pvec, page) || list_empty(list)) {
 			spin_unlock_irq(&zone->lru_lock);
@@ -1815,9 +1877,25 @@ static void shrink_zone(int priority, struct zone *zone,
 	enum lru_list l;
 	unsigned long nr_reclaimed = sc->nr_reclaimed;
 	unsigned long nr_to_reclaim = sc->nr_to_reclaim;
+	int lru_gen = scanning_global_lru(sc) && lru_gen_zone_enabled(zone);
 
 	get_scan_count(zone, sc, nr, priority);
 
+	if (lru_gen) {
+		/*
+		 * There are no active lists to balance: all of a type's
+		 * pages are scanned from its oldest generation, and the
+		 * page tables are walked for a new generation whenever
+		 * fewer than MIN_NR_GENS + 1 are left to evict from.
+		 */
+		for (l = LRU_BASE; l <= LRU_FILE; l += LRU_FILE) {
+			nr[l] += nr[l + LRU_ACTIVE];
+			nr[l + LRU_ACTIVE] = 0;
+			if (nr[l] && lru_gen_need_aging(zone, is_file_lru(l)))
+				lru_gen_age();
+		}
+	}
+
 	while (nr[LRU_INACTIVE_ANON] || nr[LRU_ACTIVE_FILE] ||
 					nr[LRU_INACTIVE_FILE]) {
 		for_each_evictable_lru(l) {
@@ -1848,7 +1926,7 @@ static void shrink_zone(int priority, struct zone *zone,
 	 * Even if we did not try to evict anon pages at all, we want to
 	 * rebalance the anon lru active/inactive ratio.
 	 */
-	if (inactive_anon_is_low(zone, sc))
+	if (!lru_gen && inactive_anon_is_low(zone, sc))
 		shrink_active_list(SWAP_CLUSTER_MAX, zone, sc, priority, 0);
 
 	throttle_vm_writeout(sc->gfp_mask);
@@ -2904,10 +2982,12 @@ retry:
 	if (page_evictable(page, NULL)) {
 		enum lru_list l = page_lru_base_type(page);
 
-		__dec_zone_state(zone, NR_UNEVICTABLE);
-		list_move(&page->lru, &zone->lru[l].list);
+		__mod_zone_page_state(zone, NR_UNEVICTABLE,
+				      -hpage_nr_pages(page));
+		list_move(&page->lru, zone_lru_list(zone, l));
 		mem_cgroup_move_lists(page, LRU_UNEVICTABLE, l);
-		__inc_zone_state(zone, NR_INACTIVE_ANON + l);
+		__mod_zone_page_state(zone, NR_INACTIVE_ANON + l,
+				      hpage_nr_pages(page));
 		__count_vm_event(UNEVICTABLE_PGRESCUED);
 	} else {
 		/*
@@ -0,0 +1,181 @@
+/*
+ *
+ * futex-hash.c
+ *
+ * hash: Benchmark for the futex hash table
+ *
+ * Every thread keeps calling FUTEX_WAIT on its own set of futexes with a
+ * value that does not match, so that each call only looks up and locks
+ * the hash bucket of the futex and returns -EWOULDBLOCK.  The rate of
+ * calls shows how well the hash spreads the futexes over the buckets and
+ * how much the threads contend on the bucket locks.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#ifndef PR_SET_FUTEX_HASH
+#define PR_SET_FUTEX_HASH 35
+#define PR_GET_FUTEX_HASH 36
+#endif
+
+static int nthreads;
+static int nfutexes = 1024;
+static int runtime = 10;
+static bool shared;
+static int hash_slots = -1;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nthreads,
+		    "Specify number of threads (default: number of CPUs)"),
+	OPT_INTEGER('f', "futexes", &nfutexes,
+		    "Specify number of futexes per thread"),
+	OPT_INTEGER('r', "runtime", &runtime,
+		    "Specify runtime in seconds"),
+	OPT_BOOLEAN('s', "shared", &shared,
+		    "Use shared futexes instead of private ones"),
+	OPT_INTEGER('H', "hash-slots", &hash_slots,
+		    "Use a private futex hash of this size (0: default size)"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+struct worker {
+	pthread_t thread;
+	u32 *futexes;
+	unsigned long ops;
+};
+
+static volatile int done;
+static pthread_barrier_t start_barrier;
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	int op = FUTEX_WAIT | (shared ? 0 : FUTEX_PRIVATE_FLAG);
+	unsigned long ops = 0;
+	int i, ret;
+
+	pthread_barrier_wait(&start_barrier);
+	while (!done) {
+		for (i = 0; i < nfutexes; i++) {
+			ret = syscall(SYS_futex, &w->futexes[i], op, 1,
+				      NULL, NULL, 0);
+			if (ret != -1 || errno != EWOULDBLOCK) {
+				fprintf(stderr, "futex wait: unexpected %s\n",
+					ret ? strerror(errno) : "wakeup");
+				exit(1);
+			}
+		}
+		ops += nfutexes;
+	}
+	w->ops = ops;
+	return NULL;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct worker *workers;
+	struct timeval start, stop, diff;
+	unsigned long long total = 0, usecs;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_hash_usage, 0);
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nfutexes <= 0 || runtime <= 0)
+		usage_with_options(bench_futex_hash_usage, options);
+
+	/* Must be done while there is only one thread */
+	if (hash_slots >= 0 &&
+	    prctl(PR_SET_FUTEX_HASH, hash_slots, 0, 0, 0)) {
+		if (errno == EINVAL && prctl(PR_GET_FUTEX_HASH, 0, 0, 0, 0) < 0)
+			fprintf(stderr, "This kernel has no private futex "
+				"hash, run without -H to compare\n");
+		else
+			fprintf(stderr, "PR_SET_FUTEX_HASH: %s\n",
+				strerror(errno));
+		return 1;
+	}
+
+	workers = calloc(nthreads, sizeof(*workers));
+	BUG_ON(!workers);
+	pthread_barrier_init(&start_barrier, NULL, nthreads + 1);
+
+	for (i = 0; i < nthreads; i++) {
+		workers[i].futexes = calloc(nfutexes, sizeof(u32));
+		BUG_ON(!workers[i].futexes);
+		BUG_ON(pthread_create(&workers[i].thread, NULL,
+				      worker_fn, &workers[i]));
+	}
+
+	pthread_barrier_wait(&start_barrier);
+	gettimeofday(&start, NULL);
+	sleep(runtime);
+	done = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		BUG_ON(pthread_join(workers[i].thread, NULL));
+		total += workers[i].ops;
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	usecs = diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d threads on %d %s futexes each, ", nthreads,
+		       nfutexes, shared ? "shared" : "private");
+		if (hash_slots >= 0)
+			printf("private hash of %d buckets\n\n",
+			       prctl(PR_GET_FUTEX_HASH, 0, 0, 0, 0));
+		else
+			printf("global hash\n\n");
+
+		for (i = 0; i < nthreads; i++)
+			printf(" thread %3d: %14.0f ops/sec\n", i,
+			       (double)workers[i].ops * 1000000 / usecs);
+		printf("\n %14.0f ops/sec in total\n",
+		       (double)total * 1000000 / usecs);
+		printf(" %14.0f ops/sec per thread on average\n",
+		       (double)total * 1000000 / usecs / nthreads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f\n", (double)total * 1000000 / usecs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	for (i = 0; i < nthreads; i++)
+		free(workers[i].futexes);
+	free(workers);
+	return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ *
+ * mem-pagefault.c
+ *
+ * pagefault: Benchmark for page faults racing with mmap()/munmap()
+ *
+ * Fault threads keep touching the pages of their own anonymous area and
+ * dropping them again with MADV_DONTNEED, so that every touch takes a
+ * page fault, which holds mmap_sem for reading.  At the same time mapper
+ * threads keep mapping and unmapping small areas of the same process,
+ * which take mmap_sem for writing.  This is what a multithreaded program
+ * with an allocator returning memory to the kernel does to mmap_sem; the
+ * voluntary context switch rate shows how often the lockers had to sleep.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static int nr_faulters;
+static int nr_mappers = 1;
+static int area_mb = 16;
+static int runtime = 10;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_faulters,
+		    "Specify number of fault threads (default: number of CPUs)"),
+	OPT_INTEGER('m', "mappers", &nr_mappers,
+		    "Specify number of mmap/munmap threads"),
+	OPT_INTEGER('s', "size", &area_mb,
+		    "Specify size of the area of each fault thread in MB"),
+	OPT_INTEGER('r', "runtime", &runtime,
+		    "Specify runtime in seconds"),
+	OPT_END()
+};
+
+static const char * const bench_mem_pagefault_usage[] = {
+	"perf bench mem pagefault <options>",
+	NULL
+};
+
+struct worker {
+	pthread_t thread;
+	unsigned long ops;
+};
+
+static volatile int done;
+static pthread_barrier_t start_barrier;
+static long page_size;
+
+static void *faulter_fn(void *arg)
+{
+	struct worker *w = arg;
+	size_t size = (size_t)area_mb << 20;
+	unsigned long ops = 0;
+	char *area;
+	size_t off;
+
+	area = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	BUG_ON(area == MAP_FAILED);
+
+	pthread_barrier_wait(&start_barrier);
+	while (!done) {
+		for (off = 0; off < size && !done; off += page_size) {
+			area[off] = 1;
+			ops++;
+		}
+		BUG_ON(madvise(area, size, MADV_DONTNEED));
+	}
+
+	munmap(area, size);
+	w->ops = ops;
+	return NULL;
+}
+
+static void *mapper_fn(void *arg)
+{
+	struct worker *w = arg;
+	size_t size = 16 * page_size;
+	unsigned long ops = 0;
+	char *area;
+
+	pthread_barrier_wait(&start_barrier);
+	while (!done) {
+		area = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		BUG_ON(area == MAP_FAILED);
+		area[0] = 1;
+		BUG_ON(munmap(area, size));
+		ops++;
+	}
+
+	w->ops = ops;
+	return NULL;
+}
+
+static double usecs_of(struct timeval *tv)
+{
+	return tv->tv_sec * 1000000.0 + tv->tv_usec;
+}
+
+int bench_mem_pagefault(int argc, const char **argv,
+			const char *prefix __used)
+{
+	struct worker *workers;
+	struct timeval start, stop, diff;
+	struct rusage ru_start, ru_stop;
+	unsigned long long faults = 0, maps = 0, vcsw, ivcsw;
+	double usecs;
+	int i, nr;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_pagefault_usage, 0);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (nr_faulters <= 0)
+		nr_faulters = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_mappers < 0 || area_mb <= 0 || runtime <= 0)
+		usage_with_options(bench_mem_pagefault_usage, options);
+
+	nr = nr_faulters + nr_mappers;
+	workers = calloc(nr, sizeof(*workers));
+	BUG_ON(!workers);
+	pthread_barrier_init(&start_barrier, NULL, nr + 1);
+
+	for (i = 0; i < nr; i++)
+		BUG_ON(pthread_create(&workers[i].thread, NULL,
+				      i < nr_faulters ? faulter_fn : mapper_fn,
+				      &workers[i]));
+
+	pthread_barrier_wait(&start_barrier);
+	getrusage(RUSAGE_SELF, &ru_start);
+	gettimeofday(&start, NULL);
+	sleep(runtime);
+	done = 1;
+
+	for (i = 0; i < nr; i++) {
+		BUG_ON(pthread_join(workers[i].thread, NULL));
+		if (i < nr_faulters)
+			faults += workers[i].ops;
+		else
+			maps += workers[i].ops;
+	}
+	gettimeofday(&stop, NULL);
+	getrusage(RUSAGE_SELF, &ru_stop);
+	timersub(&stop, &start, &diff);
+	usecs = usecs_of(&diff);
+	/* sleeping on mmap_sem is voluntary, preemption is not */
+	vcsw = ru_stop.ru_nvcsw - ru_start.ru_nvcsw;
+	ivcsw = ru_stop.ru_nivcsw - ru_start.ru_nivcsw;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d fault threads on %d MB each, %d mmap/munmap "
+		       "threads\n\n", nr_faulters, area_mb, nr_mappers);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0f page faults/sec\n", faults * 1000000 / usecs);
+		printf(" %14.0f mmap+munmap/sec\n", maps * 1000000 / usecs);
+		printf(" %14.0f voluntary context switches/sec\n",
+		       vcsw * 1000000 / usecs);
+		printf(" %14.0f involuntary context switches/sec\n",
+		       ivcsw * 1000000 / usecs);
+		printf(" %14.2f [sec] of system time\n",
+		       usecs_of(&ru_stop.ru_stime) / 1000000 -
+		       usecs_of(&ru_start.ru_stime) / 1000000);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f %.0f %.0f %.0f\n", faults * 1000000 / usecs,
+		       maps * 1000000 / usecs, vcsw * 1000000 / usecs,
+		       ivcsw * 1000000 / usecs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(workers);
+	return 0;
+}